@@ -0,0 +1,327 @@
+#include "BVH.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+//helpers for working with boxes:
+namespace {
+	float half_area(glm::vec3 const &min, glm::vec3 const &max) {
+		glm::vec3 size = max - min;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+	bool box_contains(BVH::Node const &node, glm::vec3 const &min, glm::vec3 const &max) {
+		return node.min.x <= min.x && node.min.y <= min.y && node.min.z <= min.z
+		    && max.x <= node.max.x && max.y <= node.max.y && max.z <= node.max.z;
+	}
+	bool box_overlaps(BVH::Node const &node, glm::vec3 const &min, glm::vec3 const &max) {
+		return node.min.x <= max.x && node.min.y <= max.y && node.min.z <= max.z
+		    && min.x <= node.max.x && min.y <= node.max.y && min.z <= node.max.z;
+	}
+}
+
+uint32_t BVH::allocate_node() {
+	uint32_t node;
+	if (free_list != -1U) {
+		node = free_list;
+		free_list = nodes[node].parent;
+	} else {
+		node = uint32_t(nodes.size());
+		nodes.emplace_back();
+	}
+	nodes[node] = Node();
+	nodes[node].height = 0;
+	return node;
+}
+
+void BVH::free_node(uint32_t node) {
+	assert(node < nodes.size());
+	nodes[node] = Node();
+	nodes[node].parent = free_list;
+	free_list = node;
+}
+
+uint32_t BVH::insert(glm::vec3 const &min, glm::vec3 const &max, void const *data) {
+	uint32_t leaf = allocate_node();
+	nodes[leaf].min = min - glm::vec3(margin);
+	nodes[leaf].max = max + glm::vec3(margin);
+	nodes[leaf].data = data;
+	insert_leaf(leaf);
+	leaf_count += 1;
+	return leaf;
+}
+
+void BVH::remove(uint32_t leaf) {
+	assert(contains(leaf));
+	remove_leaf(leaf);
+	free_node(leaf);
+	leaf_count -= 1;
+}
+
+bool BVH::move(uint32_t leaf, glm::vec3 const &min, glm::vec3 const &max) {
+	assert(contains(leaf));
+	if (box_contains(nodes[leaf], min, max)) return false;
+
+	remove_leaf(leaf);
+	nodes[leaf].min = min - glm::vec3(margin);
+	nodes[leaf].max = max + glm::vec3(margin);
+	insert_leaf(leaf);
+	return true;
+}
+
+bool BVH::contains(uint32_t leaf) const {
+	return leaf < nodes.size() && nodes[leaf].height == 0;
+}
+
+void const *BVH::data(uint32_t leaf) const {
+	assert(contains(leaf));
+	return nodes[leaf].data;
+}
+
+void BVH::clear() {
+	nodes.clear();
+	root = -1U;
+	free_list = -1U;
+	leaf_count = 0;
+}
+
+void BVH::insert_leaf(uint32_t leaf) {
+	if (root == -1U) {
+		root = leaf;
+		nodes[root].parent = -1U;
+		return;
+	}
+
+	glm::vec3 leaf_min = nodes[leaf].min;
+	glm::vec3 leaf_max = nodes[leaf].max;
+
+	//walk down the tree to find the cheapest sibling for the new leaf:
+	// (cost is surface area, as in the "surface area heuristic")
+	uint32_t sibling = root;
+	while (!nodes[sibling].is_leaf()) {
+		Node const &node = nodes[sibling];
+		float area = half_area(node.min, node.max);
+		float combined_area = half_area(glm::min(node.min, leaf_min), glm::max(node.max, leaf_max));
+
+		//cost of making a new parent for this node and the leaf:
+		float cost = 2.0f * combined_area;
+		//cost of pushing the leaf further down (every node on the way grows by this much):
+		float inheritance_cost = 2.0f * (combined_area - area);
+
+		float child_costs[2];
+		for (uint32_t c = 0; c < 2; ++c) {
+			Node const &child = nodes[node.children[c]];
+			float child_area = half_area(glm::min(child.min, leaf_min), glm::max(child.max, leaf_max));
+			if (child.is_leaf()) child_costs[c] = child_area + inheritance_cost;
+			else child_costs[c] = (child_area - half_area(child.min, child.max)) + inheritance_cost;
+		}
+
+		if (cost < child_costs[0] && cost < child_costs[1]) break;
+		sibling = (child_costs[0] < child_costs[1] ? node.children[0] : node.children[1]);
+	}
+
+	//make a new parent for the sibling and the leaf:
+	uint32_t old_parent = nodes[sibling].parent;
+	uint32_t new_parent = allocate_node(); //(n.b. may move 'nodes', so no references are held across this)
+	nodes[new_parent].parent = old_parent;
+	nodes[new_parent].min = glm::min(nodes[sibling].min, leaf_min);
+	nodes[new_parent].max = glm::max(nodes[sibling].max, leaf_max);
+	nodes[new_parent].height = nodes[sibling].height + 1;
+	nodes[new_parent].children[0] = sibling;
+	nodes[new_parent].children[1] = leaf;
+	nodes[sibling].parent = new_parent;
+	nodes[leaf].parent = new_parent;
+
+	if (old_parent != -1U) {
+		Node &p = nodes[old_parent];
+		if (p.children[0] == sibling) p.children[0] = new_parent;
+		else p.children[1] = new_parent;
+	} else {
+		root = new_parent;
+	}
+
+	refit(old_parent);
+}
+
+void BVH::remove_leaf(uint32_t leaf) {
+	if (leaf == root) {
+		root = -1U;
+		return;
+	}
+
+	//the leaf's parent goes away, and the leaf's sibling takes its place:
+	uint32_t parent = nodes[leaf].parent;
+	uint32_t grandparent = nodes[parent].parent;
+	uint32_t sibling = (nodes[parent].children[0] == leaf ? nodes[parent].children[1] : nodes[parent].children[0]);
+
+	nodes[sibling].parent = grandparent;
+	if (grandparent != -1U) {
+		Node &g = nodes[grandparent];
+		if (g.children[0] == parent) g.children[0] = sibling;
+		else g.children[1] = sibling;
+	} else {
+		root = sibling;
+	}
+	free_node(parent);
+	nodes[leaf].parent = -1U;
+
+	refit(grandparent);
+}
+
+void BVH::refit(uint32_t node) {
+	while (node != -1U) {
+		node = balance(node);
+
+		Node &n = nodes[node];
+		Node const &a = nodes[n.children[0]];
+		Node const &b = nodes[n.children[1]];
+		n.min = glm::min(a.min, b.min);
+		n.max = glm::max(a.max, b.max);
+		n.height = 1 + std::max(a.height, b.height);
+
+		node = n.parent;
+	}
+}
+
+uint32_t BVH::balance(uint32_t a) {
+	assert(a != -1U);
+	if (nodes[a].is_leaf() || nodes[a].height < 2) return a;
+
+	int32_t skew = nodes[nodes[a].children[1]].height - nodes[nodes[a].children[0]].height;
+	if (skew >= -1 && skew <= 1) return a;
+
+	//the taller child ('c') takes a's place; a takes the shorter of c's children:
+	uint32_t k = (skew > 1 ? 1 : 0); //index of taller child in a
+	uint32_t b = nodes[a].children[1 - k];
+	uint32_t c = nodes[a].children[k];
+	uint32_t f = nodes[c].children[0];
+	uint32_t g = nodes[c].children[1];
+
+	//put c where a was:
+	nodes[c].parent = nodes[a].parent;
+	if (nodes[c].parent != -1U) {
+		Node &p = nodes[nodes[c].parent];
+		if (p.children[0] == a) p.children[0] = c;
+		else p.children[1] = c;
+	} else {
+		root = c;
+	}
+	nodes[c].children[0] = a;
+	nodes[a].parent = c;
+
+	//c keeps its taller child, a gets the other:
+	if (nodes[f].height < nodes[g].height) std::swap(f, g);
+	nodes[c].children[1] = f;
+	nodes[a].children[k] = g;
+	nodes[g].parent = a;
+
+	nodes[a].min = glm::min(nodes[b].min, nodes[g].min);
+	nodes[a].max = glm::max(nodes[b].max, nodes[g].max);
+	nodes[a].height = 1 + std::max(nodes[b].height, nodes[g].height);
+
+	nodes[c].min = glm::min(nodes[a].min, nodes[f].min);
+	nodes[c].max = glm::max(nodes[a].max, nodes[f].max);
+	nodes[c].height = 1 + std::max(nodes[a].height, nodes[f].height);
+
+	return c;
+}
+
+void BVH::query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< void(uint32_t leaf) > const &fn) const {
+	if (root == -1U) return;
+	std::vector< uint32_t > stack;
+	stack.reserve(64);
+	stack.emplace_back(root);
+	while (!stack.empty()) {
+		uint32_t n = stack.back();
+		stack.pop_back();
+		Node const &node = nodes[n];
+		if (!box_overlaps(node, min, max)) continue;
+		if (node.is_leaf()) {
+			fn(n);
+		} else {
+			stack.emplace_back(node.children[1]);
+			stack.emplace_back(node.children[0]);
+		}
+	}
+}
+
+void BVH::query_planes(glm::vec4 const *planes, uint32_t plane_count, std::function< void(uint32_t leaf) > const &fn) const {
+	assert(plane_count <= 32);
+	if (root == -1U) return;
+
+	//nodes to visit, along with a bitmask of planes they might be outside of:
+	// (once a node is entirely inside a plane, so are its children, so they don't need to test it)
+	std::vector< std::pair< uint32_t, uint32_t > > stack;
+	stack.reserve(64);
+	stack.emplace_back(root, (plane_count == 32 ? ~0U : (1U << plane_count) - 1U));
+	while (!stack.empty()) {
+		auto [n, mask] = stack.back();
+		stack.pop_back();
+		Node const &node = nodes[n];
+
+		glm::vec3 center = 0.5f * (node.max + node.min);
+		glm::vec3 radius = 0.5f * (node.max - node.min);
+		bool outside = false;
+		for (uint32_t p = 0; p < plane_count; ++p) {
+			if (!(mask & (1U << p))) continue;
+			glm::vec3 normal = glm::vec3(planes[p]);
+			float d = glm::dot(normal, center) + planes[p].w;
+			float r = glm::dot(glm::abs(normal), radius);
+			if (d + r < 0.0f) {
+				outside = true;
+				break;
+			}
+			if (d - r >= 0.0f) mask &= ~(1U << p);
+		}
+		if (outside) continue;
+
+		if (node.is_leaf()) {
+			fn(n);
+		} else {
+			stack.emplace_back(node.children[1], mask);
+			stack.emplace_back(node.children[0], mask);
+		}
+	}
+}
+
+void BVH::query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t,
+	std::function< float(uint32_t leaf, float t) > const &fn) const {
+	if (root == -1U) return;
+
+	glm::vec3 inv_direction = 1.0f / direction;
+
+	//t at which the ray enters a node's box (or > max_t if it misses):
+	auto enter = [&](Node const &node) {
+		glm::vec3 t0 = (node.min - origin) * inv_direction;
+		glm::vec3 t1 = (node.max - origin) * inv_direction;
+		glm::vec3 t_min = glm::min(t0, t1);
+		glm::vec3 t_max = glm::max(t0, t1);
+		float t_enter = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.0f));
+		float t_exit = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, max_t));
+		return (t_enter <= t_exit ? t_enter : std::numeric_limits< float >::infinity());
+	};
+
+	std::vector< std::pair< uint32_t, float > > stack;
+	stack.reserve(64);
+	stack.emplace_back(root, enter(nodes[root]));
+	while (!stack.empty()) {
+		auto [n, t] = stack.back();
+		stack.pop_back();
+		if (t > max_t) continue; //(max_t may have shrunk since this was pushed)
+		Node const &node = nodes[n];
+		if (node.is_leaf()) {
+			max_t = std::min(max_t, fn(n, t));
+		} else {
+			//visit the nearer child first, so a closest-hit search can skip the farther one:
+			float t0 = enter(nodes[node.children[0]]);
+			float t1 = enter(nodes[node.children[1]]);
+			if (t0 <= t1) {
+				stack.emplace_back(node.children[1], t1);
+				stack.emplace_back(node.children[0], t0);
+			} else {
+				stack.emplace_back(node.children[0], t0);
+				stack.emplace_back(node.children[1], t1);
+			}
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+/*
+ * A BVH is a dynamic bounding volume hierarchy of axis-aligned boxes.
+ *
+ * Leaves are added, moved, and removed incrementally. Each leaf stores a
+ * "fat" box (its box enlarged by 'margin'), so small movements don't change
+ * the tree at all, and larger movements just re-insert the one leaf.
+ *
+ * Queries (box overlap, frustum, ray) visit only the parts of the tree whose
+ * boxes pass the test. Because leaf boxes are fat, queries may report leaves
+ * that are slightly outside the query -- test further if exactness matters.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct BVH {
+	//add a leaf with box [min,max] and some user data; returns the leaf's id:
+	uint32_t insert(glm::vec3 const &min, glm::vec3 const &max, void const *data);
+
+	//remove a leaf (its id may be re-used by later insert()s):
+	void remove(uint32_t leaf);
+
+	//change a leaf's box:
+	// returns true if the tree was changed (i.e., the box wasn't inside the leaf's fat box)
+	bool move(uint32_t leaf, glm::vec3 const &min, glm::vec3 const &max);
+
+	//is 'leaf' the id of a leaf currently in the tree?
+	bool contains(uint32_t leaf) const;
+
+	//user data for a leaf:
+	void const *data(uint32_t leaf) const;
+
+	//number of leaves in the tree:
+	uint32_t size() const { return leaf_count; }
+
+	//remove all leaves:
+	void clear();
+
+	//call 'fn' for every leaf whose (fat) box overlaps [min,max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::function< void(uint32_t leaf) > const &fn) const;
+
+	//call 'fn' for every leaf whose (fat) box is not entirely outside any of the given planes:
+	// (a point p is inside plane (n,d) when dot(n,p) + d >= 0; at most 32 planes)
+	void query_planes(glm::vec4 const *planes, uint32_t plane_count, std::function< void(uint32_t leaf) > const &fn) const;
+
+	//call 'fn' for every leaf whose (fat) box is hit by the ray origin + t * direction for t in [0,max_t]:
+	// 'fn' is passed the leaf and the t at which the ray enters its box, and returns a new max_t
+	// (e.g., return max_t to find every hit; return the distance to an actual hit to find the closest one)
+	void query_ray(glm::vec3 const &origin, glm::vec3 const &direction, float max_t,
+		std::function< float(uint32_t leaf, float t) > const &fn) const;
+
+	//extra space around leaf boxes, so that objects can move a bit without changing the tree:
+	float margin = 0.1f;
+
+	//internals:
+	struct Node {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		uint32_t parent = -1U; //(or next free node, for nodes on the free list)
+		uint32_t children[2] = {-1U, -1U}; //(-1U for leaves)
+		int32_t height = -1; //0 for leaves, -1 for free nodes
+		void const *data = nullptr; //(leaves only)
+		bool is_leaf() const { return children[0] == -1U; }
+	};
+	std::vector< Node > nodes;
+	uint32_t root = -1U;
+	uint32_t free_list = -1U;
+	uint32_t leaf_count = 0;
+
+	uint32_t allocate_node();
+	void free_node(uint32_t node);
+	void insert_leaf(uint32_t leaf);
+	void remove_leaf(uint32_t leaf);
+	uint32_t balance(uint32_t node); //rotate around 'node' if its children's heights differ by more than one; returns new subtree root
+	void refit(uint32_t node); //fix up boxes and heights from 'node' to the root
+};
@@ -0,0 +1,159 @@
+#include "ChunkFile.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	//map the whole file:
+	#if defined(_WIN32)
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	file_handle = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	mapped_size = size_t(size.QuadPart);
+	if (mapped_size > 0) {
+		mapping_handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping_handle) mapped = reinterpret_cast< uint8_t const * >(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+		if (!mapped) {
+			if (mapping_handle) CloseHandle(mapping_handle);
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "'.");
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of '" + filename + "'.");
+	}
+	mapped_size = size_t(info.st_size);
+	if (mapped_size > 0) {
+		void *map = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map '" + filename + "'.");
+		}
+		mapped = reinterpret_cast< uint8_t const * >(map);
+	}
+	close(fd); //(the mapping stays valid)
+	#endif
+
+	//find all the chunks (only headers are touched, so only their pages get read):
+	struct ChunkHeader {
+		char magic[4];
+		uint32_t size;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	if (mapped_size >= sizeof(ChunkHeader) && std::memcmp(mapped, "toc0", 4) == 0) {
+		//...or just the table of contents, if there is one:
+		ChunkHeader header;
+		std::memcpy(&header, mapped, sizeof(header));
+		Chunk toc;
+		std::memcpy(toc.magic, header.magic, 4);
+		toc.offset = sizeof(header);
+		toc.size = header.size;
+		if (mapped_size - sizeof(header) < header.size || header.size % sizeof(TOCEntry) != 0) {
+			unmap();
+			throw std::runtime_error("Table of contents in '" + filename + "' is the wrong size.");
+		}
+		chunks.emplace_back(toc);
+		uint64_t end = toc.offset + toc.size; //(chunks must follow the table of contents, in order)
+		for (uint32_t i = 0; i < header.size / sizeof(TOCEntry); ++i) {
+			TOCEntry entry;
+			std::memcpy(&entry, mapped + toc.offset + i * sizeof(TOCEntry), sizeof(entry));
+			if (entry.offset < end + sizeof(ChunkHeader) || entry.offset > mapped_size || mapped_size - entry.offset < entry.size) {
+				unmap();
+				throw std::runtime_error("Table of contents in '" + filename + "' has an out-of-range entry.");
+			}
+			Chunk chunk;
+			std::memcpy(chunk.magic, entry.magic, 4);
+			chunk.offset = size_t(entry.offset);
+			chunk.size = entry.size;
+			chunk.has_crc = true;
+			chunk.crc = entry.crc;
+			chunks.emplace_back(chunk);
+			end = entry.offset + entry.size;
+		}
+		next = 1; //(sequential reads start after the table of contents)
+		return;
+	}
+
+	size_t at = 0;
+	while (at < mapped_size) {
+		if (mapped_size - at < sizeof(ChunkHeader)) {
+			unmap();
+			throw std::runtime_error("Failed to read chunk header at end of '" + filename + "'.");
+		}
+		ChunkHeader header;
+		std::memcpy(&header, mapped + at, sizeof(header));
+		at += sizeof(header);
+		if (mapped_size - at < header.size) {
+			std::string magic(header.magic, 4);
+			unmap();
+			throw std::runtime_error("Data of '" + magic + "' chunk runs past the end of '" + filename + "'.");
+		}
+		Chunk chunk;
+		std::memcpy(chunk.magic, header.magic, 4);
+		chunk.offset = at;
+		chunk.size = header.size;
+		chunks.emplace_back(chunk);
+		at += header.size;
+	}
+}
+
+ChunkFile::~ChunkFile() {
+	unmap();
+}
+
+void ChunkFile::unmap() {
+	#if defined(_WIN32)
+	if (mapped) UnmapViewOfFile(mapped);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	mapping_handle = nullptr;
+	file_handle = nullptr;
+	#else
+	if (mapped) munmap(const_cast< uint8_t * >(mapped), mapped_size);
+	#endif
+	mapped = nullptr;
+	mapped_size = 0;
+}
+
+std::string ChunkFile::peek_magic() const {
+	if (next >= chunks.size()) return "";
+	return std::string(chunks[next].magic, 4);
+}
+
+ChunkFile::Chunk const *ChunkFile::find(std::string const &magic) const {
+	for (auto const &chunk : chunks) {
+		if (chunk.is(magic)) return &chunk;
+	}
+	return nullptr;
+}
+
+void ChunkFile::validate() const {
+	for (auto const &chunk : chunks) {
+		if (!chunk.has_crc) continue;
+		if (crc32(mapped + chunk.offset, chunk.size) != chunk.crc) {
+			throw std::runtime_error("Data of '" + std::string(chunk.magic, 4) + "' chunk in '" + filename + "' doesn't match its checksum.");
+		}
+	}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+/*
+ * ChunkFile memory-maps a file made of chunks (as written by write_chunk() in
+ *  read_write_chunk.hpp) and hands out typed views ("spans") of chunk data
+ *  that point straight into the mapping, so nothing is copied or zeroed.
+ *
+ * Usage:
+ *   ChunkFile file(filename); //throws if the file can't be mapped or its chunks run past its end
+ *   ChunkFile::Span< char > names = file.read< char >("str0"); //chunks in order, like read_chunk()
+ *   ChunkFile::Chunk const *lights = file.find("lmp0"); //...or by magic number (nullptr if missing)
+ *   ChunkFile::Span< Vertex > vertices = file.view< Vertex >("pnct"); //(view of a chunk found by magic number; throws if missing)
+ *
+ * Spans are only valid as long as the ChunkFile is.
+ *
+ * If the file starts with a table of contents ('toc0' chunk, see TOCEntry in read_write_chunk.hpp),
+ *  'chunks' comes from it, so opening the file only touches the table of contents (not every chunk header),
+ *  and validate() can check each chunk's CRC. The 'toc0' chunk itself is chunks[0], and is skipped by read().
+ * Otherwise, chunk headers are read one after another.
+ *
+ * Data can only be viewed as T if it is aligned for T in the file.
+ * Chunk headers are 8 bytes, so a chunk's data is 4-byte aligned if the sizes of all earlier chunks
+ *  are multiples of 4 (which is why writers pad 'str0' chunks). For files where that isn't the case,
+ *  read() and view() can copy misaligned data to a 'fallback' vector instead of throwing.
+ */
+
+#include "read_write_chunk.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+struct ChunkFile {
+	explicit ChunkFile(std::string const &filename);
+	~ChunkFile();
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+
+	//read-only view of an array of T:
+	template< typename T >
+	struct Span {
+		Span() = default;
+		Span(T const *data_, size_t size_) : ptr(data_), count(size_) { }
+		T const *data() const { return ptr; }
+		size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+		T const *begin() const { return ptr; }
+		T const *end() const { return ptr + count; }
+		T const &operator[](size_t i) const { assert(i < count); return ptr[i]; }
+
+		T const *ptr = nullptr;
+		size_t count = 0;
+	};
+
+	struct Chunk {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		size_t offset = 0; //offset of the chunk's data (just after its header) in the file
+		uint32_t size = 0; //size of the chunk's data, in bytes
+		bool has_crc = false; //(true if listed in a table of contents)
+		uint32_t crc = 0; //CRC-32 of the chunk's data, according to the table of contents
+		bool is(std::string const &magic_) const { return magic_.size() == 4 && std::memcmp(magic, magic_.data(), 4) == 0; }
+	};
+	std::vector< Chunk > chunks; //every chunk in the file, in order
+
+	//sequential reading (as with read_chunk()):
+	size_t next = 0; //index in 'chunks' of the next chunk read() will read
+
+	//magic number of the next chunk, or "" after the last chunk:
+	std::string peek_magic() const;
+
+	//view the next chunk, which must have the given magic number, as an array of T:
+	// note: throws if the next chunk has a different magic number, isn't a whole number of T's,
+	//  or isn't aligned for T (unless 'fallback' is given, in which case data is copied there instead)
+	template< typename T >
+	Span< T > read(std::string const &magic, std::vector< T > *fallback = nullptr);
+
+	//random access:
+	Chunk const *find(std::string const &magic) const; //first chunk with the given magic number, or nullptr
+
+	//view any chunk as an array of T (same checks as read()):
+	template< typename T >
+	Span< T > view(Chunk const &chunk, std::vector< T > *fallback = nullptr) const;
+
+	//view the first chunk with the given magic number (throws if there isn't one):
+	template< typename T >
+	Span< T > view(std::string const &magic, std::vector< T > *fallback = nullptr) const;
+
+	//check chunk data against the table of contents' CRCs:
+	// note: throws on mismatch; reads all of the file's data, so only call this when you're reading it all anyway
+	bool has_toc() const { return !chunks.empty() && chunks[0].is("toc0"); }
+	void validate() const;
+
+	std::string filename; //(for error messages)
+
+	//internals:
+	uint8_t const *mapped = nullptr; //the whole file (nullptr if the file is empty)
+	size_t mapped_size = 0;
+	#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+	void unmap(); //(used by the destructor, and by the constructor when it throws)
+};
+
+template< typename T >
+ChunkFile::Span< T > ChunkFile::read(std::string const &magic, std::vector< T > *fallback) {
+	if (next >= chunks.size()) {
+		throw std::runtime_error("Expected '" + magic + "' chunk at end of '" + filename + "'.");
+	}
+	if (!chunks[next].is(magic)) {
+		throw std::runtime_error("Expected '" + magic + "' chunk in '" + filename + "', found '" + peek_magic() + "'.");
+	}
+	next += 1;
+	return view< T >(chunks[next-1], fallback);
+}
+
+template< typename T >
+ChunkFile::Span< T > ChunkFile::view(Chunk const &chunk, std::vector< T > *fallback) const {
+	static_assert(std::is_trivially_copyable< T >::value, "chunk data must be trivially copyable");
+	if (chunk.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of '" + std::string(chunk.magic, 4) + "' chunk in '" + filename + "' not divisible by element size.");
+	}
+	size_t count = chunk.size / sizeof(T);
+	if (count == 0) return Span< T >();
+
+	uint8_t const *data = mapped + chunk.offset;
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		if (!fallback) {
+			throw std::runtime_error("Data of '" + std::string(chunk.magic, 4) + "' chunk in '" + filename + "' is not aligned.");
+		}
+		fallback->resize(count);
+		std::memcpy(fallback->data(), data, chunk.size);
+		return Span< T >(fallback->data(), count);
+	}
+	return Span< T >(reinterpret_cast< T const * >(data), count);
+}
+
+template< typename T >
+ChunkFile::Span< T > ChunkFile::view(std::string const &magic, std::vector< T > *fallback) const {
+	Chunk const *chunk = find(magic);
+	if (!chunk) {
+		throw std::runtime_error("Expected '" + magic + "' chunk in '" + filename + "'.");
+	}
+	return view< T >(*chunk, fallback);
+}
@@ -6,6 +6,12 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <deque>
+#include <iostream>
+
 //All DrawLines instances share a vertex array object and vertex buffer, initialized at load time:
 
 //n.b. declared static so they don't conflict with similarly named global variables elsewhere:
@@ -17,7 +23,7 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 
 	{ //set up vertex buffer:
 		glGenBuffers(1, &vertex_buffer);
-		//for now, buffer will be un-filled.
+		//for now, buffer will be un-filled. (storage is allocated on first upload)
 	}
 
 	{ //vertex array mapping buffer for color_program:
@@ -63,6 +69,140 @@ static Load< void > setup_buffers(LoadTagDefault, [](){
 });
 
 
+//vertex_buffer is used as a ring buffer: each upload is written just after the previous one
+// (mapped with GL_MAP_UNSYNCHRONIZED_BIT, so the driver doesn't have to wait for or copy anything)
+// and fences record when the GPU is done reading each upload, so it isn't overwritten too soon.
+//Positions in the ring are counted without wrapping ('stream positions'); position p lives at byte p % stream_capacity:
+static uint64_t stream_capacity = 0; //size of vertex_buffer's storage, in bytes
+static uint64_t stream_head = 0; //stream position of the next upload
+struct StreamFence {
+	uint64_t begin; //stream position of the start of the (first) upload being read
+	GLsync fence; //signaled once the GPU has finished the draws that read the upload(s)
+};
+static std::deque< StreamFence > stream_fences; //oldest first
+//uploads that start in the same 1/StreamSegments of the buffer share a fence (so only a few fences are ever outstanding):
+static constexpr uint64_t StreamSegments = 16;
+
+//copy vertices into the ring buffer, returning the index of the first one (and its stream position in *begin_):
+// (leaves vertex_buffer bound to GL_ARRAY_BUFFER)
+static GLint stream_vertices(DrawLines::Vertex const *vertices, size_t count, uint64_t *begin_) {
+	uint64_t bytes = count * sizeof(DrawLines::Vertex);
+
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+
+	if (bytes > stream_capacity) {
+		//(re-)allocate storage big enough for this upload:
+		// (re-specifying the storage means the driver will keep the old storage around for draws that still read it)
+		stream_capacity = std::max< uint64_t >(uint64_t(4) << 20, 2 * bytes);
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(stream_capacity), nullptr, GL_STREAM_DRAW);
+		stream_head = 0;
+		for (auto const &f : stream_fences) glDeleteSync(f.fence);
+		stream_fences.clear();
+	}
+
+	//don't let an upload straddle the end of the buffer:
+	if (stream_head % stream_capacity + bytes > stream_capacity) {
+		stream_head += stream_capacity - stream_head % stream_capacity;
+	}
+	uint64_t begin = stream_head;
+	uint64_t end = begin + bytes;
+	stream_head = end;
+
+	//wait until the GPU is done with everything that was stored where this upload goes:
+	// (usually long since done, since that was a whole buffer's worth of uploads ago)
+	while (!stream_fences.empty() && stream_fences.front().begin + stream_capacity < end) {
+		GLenum result = glClientWaitSync(stream_fences.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL);
+		if (result == GL_TIMEOUT_EXPIRED) continue;
+		if (result == GL_WAIT_FAILED) {
+			std::cerr << "WARNING: failed to wait on DrawLines buffer fence; lines may flicker." << std::endl;
+		}
+		glDeleteSync(stream_fences.front().fence);
+		stream_fences.pop_front();
+	}
+
+	uint64_t offset = begin % stream_capacity;
+	void *mapped = glMapBufferRange(GL_ARRAY_BUFFER, GLintptr(offset), GLsizeiptr(bytes),
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (mapped) {
+		std::memcpy(mapped, vertices, bytes);
+		if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+			//(storage got corrupted while mapped -- rare, e.g. on a display mode change; lines will just be wrong for a frame)
+			std::cerr << "WARNING: DrawLines buffer contents lost while mapped." << std::endl;
+		}
+	} else {
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(offset), GLsizeiptr(bytes), vertices);
+	}
+
+	*begin_ = begin;
+	return GLint(offset / sizeof(DrawLines::Vertex));
+}
+
+//a run of lines to draw with one call:
+struct LinesDraw {
+	glm::mat4 world_to_clip;
+	size_t first; //first vertex (in the vertices being drawn)
+	size_t count; //number of vertices
+};
+
+//upload 'vertices' and run 'draws' on them:
+static void draw_streamed(std::vector< DrawLines::Vertex > const &vertices, std::vector< LinesDraw > const &draws) {
+	uint64_t begin;
+	GLint base = stream_vertices(vertices.data(), vertices.size(), &begin);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	//set color_program as current program:
+	glUseProgram(color_program->program);
+
+	//use the mapping vertex_buffer_for_color_program to fetch vertex data:
+	glBindVertexArray(vertex_buffer_for_color_program);
+
+	for (size_t i = 0; i < draws.size(); ++i) {
+		//upload OBJECT_TO_CLIP to the proper uniform location (if it changed):
+		if (i == 0 || draws[i].world_to_clip != draws[i-1].world_to_clip) {
+			glUniformMatrix4fv(color_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(draws[i].world_to_clip));
+		}
+
+		//run the OpenGL pipeline:
+		glDrawArrays(GL_LINES, base + GLint(draws[i].first), GLsizei(draws[i].count));
+	}
+
+	//mark when the GPU will be done reading the upload:
+	// (a fence is signaled after *all* earlier commands, so it can replace the fence of a nearby earlier upload)
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	uint64_t segment = stream_capacity / StreamSegments;
+	if (!stream_fences.empty() && stream_fences.back().begin / segment == begin / segment) {
+		glDeleteSync(stream_fences.back().fence);
+		stream_fences.back().fence = fence;
+	} else {
+		stream_fences.emplace_back(StreamFence{begin, fence});
+	}
+
+	//reset vertex array to none:
+	glBindVertexArray(0);
+
+	//reset current program to none:
+	glUseProgram(0);
+}
+
+//lines waiting for the current batch to end:
+static uint32_t batch_depth = 0;
+static std::vector< DrawLines::Vertex > batch_vertices;
+static std::vector< LinesDraw > batch_draws;
+
+DrawLines::Batch::Batch() {
+	batch_depth += 1;
+}
+
+DrawLines::Batch::~Batch() {
+	assert(batch_depth > 0);
+	batch_depth -= 1;
+	if (batch_depth > 0 || batch_vertices.empty()) return;
+
+	draw_streamed(batch_vertices, batch_draws);
+	batch_vertices.clear();
+	batch_draws.clear();
+}
+
 DrawLines::DrawLines(glm::mat4 const &world_to_clip_) : world_to_clip(world_to_clip_) {
 }
 
@@ -90,26 +230,39 @@ void DrawLines::draw_box(glm::mat4x3 const &mat, glm::u8vec4 const &color) {
 	draw(mat * glm::vec4( 1.0f, 1.0f,-1.0f, 1.0f), mat * glm::vec4( 1.0f, 1.0f, 1.0f, 1.0f), color);
 }
 
-void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, glm::vec3 const &x, glm::vec3 const &y, glm::u8vec4 const &color, glm::vec3 *anchor_out) {
+void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, glm::vec3 const &x, glm::vec3 const &y, glm::u8vec4 const &color, glm::vec3 *anchor_out, TextCache *cache) {
+	//same text drawn at the same size as last time? just copy it (moved to the new anchor):
+	TextCache::Entry *entry = nullptr;
+	if (cache) {
+		auto f = cache->entries.find(text);
+		if (f != cache->entries.end()) {
+			entry = &f->second;
+			if (entry->x == x && entry->y == y) {
+				cache->hits += 1;
+				attribs.reserve(attribs.size() + entry->offsets.size());
+				for (glm::vec3 const &offset : entry->offsets) {
+					attribs.emplace_back(anchor_in + offset, color);
+				}
+				if (anchor_out) *anchor_out = anchor_in + entry->advance;
+				return;
+			}
+		} else {
+			if (cache->entries.size() >= TextCache::Capacity) cache->entries.clear();
+			entry = &cache->entries[text];
+		}
+		cache->misses += 1;
+	}
+	size_t first_attrib = attribs.size();
 
 	glm::vec3 anchor = anchor_in;
 
 	uint32_t start = 0;
 	while (start < text.size()) {
-		uint32_t end = start;
-		uint32_t glyph = -1U;
-		while (end < text.size()) {
-			end += 1;
-			auto f = PathFont::font.glyph_map.find(text.substr(start, end-start));
-			if (f == PathFont::font.glyph_map.end()) {
-				end -= 1;
-				break;
-			}
-			glyph = f->second;
-		}
+		//find the longest glyph that matches the text here:
+		uint32_t length = 0;
+		uint32_t glyph = PathFont::font.match_glyph(text.data() + start, text.data() + text.size(), &length);
 		if (glyph == -1U) {
-			assert(start == end);
-			end += 1;
+			length = 1;
 			//missing! draw a tofu:
 			for (const auto &pt : {
 				glm::vec2(0.1f, 0.1f), glm::vec2(0.6f, 0.1f),
@@ -126,39 +279,39 @@ void DrawLines::draw_text(std::string const &text, glm::vec3 const &anchor_in, g
 			}
 			anchor += x * PathFont::font.glyph_widths[glyph];
 		}
-		start = end;
+		start += length;
 	}
 
 	if (anchor_out) *anchor_out = anchor;
+
+	if (entry) {
+		entry->x = x;
+		entry->y = y;
+		entry->advance = anchor - anchor_in;
+		entry->offsets.clear();
+		for (size_t i = first_attrib; i < attribs.size(); ++i) {
+			entry->offsets.emplace_back(attribs[i].Position - anchor_in);
+		}
+	}
 }
 
 DrawLines::~DrawLines() {
 	if (attribs.empty()) return;
 
-	//based on DrawSprites.cpp :
-
-	//upload vertices to vertex_buffer:
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer); //set vertex_buffer as current
-	glBufferData(GL_ARRAY_BUFFER, attribs.size() * sizeof(attribs[0]), attribs.data(), GL_STREAM_DRAW); //upload attribs array
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-
-	//set color_program as current program:
-	glUseProgram(color_program->program);
-
-	//upload OBJECT_TO_CLIP to the proper uniform location:
-	glUniformMatrix4fv(color_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
-
-	//use the mapping vertex_buffer_for_color_program to fetch vertex data:
-	glBindVertexArray(vertex_buffer_for_color_program);
-
-	//run the OpenGL pipeline:
-	glDrawArrays(GL_LINES, 0, GLsizei(attribs.size()));
-
-	//reset vertex array to none:
-	glBindVertexArray(0);
+	if (batch_depth > 0) {
+		//leave drawing to the batch:
+		// (extending the previous draw if it used the same matrix, since batch vertices are contiguous)
+		if (!batch_draws.empty() && batch_draws.back().world_to_clip == world_to_clip) {
+			batch_draws.back().count += attribs.size();
+		} else {
+			batch_draws.emplace_back(LinesDraw{world_to_clip, batch_vertices.size(), attribs.size()});
+		}
+		batch_vertices.insert(batch_vertices.end(), attribs.begin(), attribs.end());
+		return;
+	}
 
-	//reset current program to none:
-	glUseProgram(0);
+	//based on DrawSprites.cpp (but uploading to the ring buffer, above):
+	static std::vector< LinesDraw > draws(1);
+	draws[0] = LinesDraw{world_to_clip, 0, attribs.size()};
+	draw_streamed(attribs, draws);
 }
-
-
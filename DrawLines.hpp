@@ -6,12 +6,27 @@
  *
  * Similar usage pattern to DrawSprites.
  *
+ * Lines are drawn when the DrawLines is destroyed -- unless a DrawLines::Batch
+ *  exists, in which case they are drawn (along with the lines of every other
+ *  DrawLines destroyed meanwhile) when the batch is destroyed:
+ *
+ * {
+ *     DrawLines::Batch batch;
+ *     for (auto const &thing : things) {
+ *         DrawLines lines(world_to_clip);
+ *         lines.draw_box(thing.box);
+ *     } //(lines not drawn yet)
+ * } //all the boxes are drawn here, with one upload and one draw call
+ *
+ * Vertices are streamed through a ring buffer shared by all DrawLines.
+ *
  */
 
 
 #include <glm/glm.hpp>
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 struct DrawLines {
@@ -24,6 +39,11 @@ struct DrawLines {
 	//draw a wireframe box corresponding to the [-1,1]^3 cube transformed by mat:
 	void draw_box(glm::mat4x3 const &mat, glm::u8vec4 const &color = glm::u8vec4(0xff));
 
+	//TextCache remembers the lines of recently drawn text (relative to its anchor), so drawing the same text at the same size again is just a copy:
+	// (the anchor and color can differ between draws, so e.g. text and its drop shadow share an entry)
+	// (useful for text that is drawn every frame, like a HUD; holds up to Capacity strings, and is emptied when it fills up)
+	struct TextCache;
+
 	//draw wireframe text, start at anchor, move in x direction, mat gives x and y directions for text drawing:
 	// (default character box is 1 unit high)
 	void draw_text(std::string const &text,
@@ -31,11 +51,22 @@ struct DrawLines {
 		glm::vec3 const &x = glm::vec3(1.0f, 0.0f, 0.0f),
 		glm::vec3 const &y = glm::vec3(0.0f, 1.0f, 1.0f),
 		glm::u8vec4 const &color = glm::u8vec4(0xff),
-		glm::vec3 *anchor_out = nullptr);
+		glm::vec3 *anchor_out = nullptr,
+		TextCache *cache = nullptr);
 
-	//Finish drawing (push attribs to GPU):
+	//Finish drawing (push attribs to GPU, or hand them to the current Batch):
 	~DrawLines();
 
+	//Batch defers the drawing of every DrawLines destroyed during its lifetime until it is destroyed:
+	// - lines are uploaded together and drawn with one draw call per run of DrawLines with the same world_to_clip
+	// - lines are drawn using the OpenGL state (depth test, blending, ...) that is current when the batch ends
+	// - batches can nest (lines are drawn when the outermost batch ends)
+	struct Batch {
+		Batch();
+		~Batch();
+		Batch(Batch const &) = delete;
+	};
+
 
 	glm::mat4 world_to_clip;
 	struct Vertex {
@@ -46,3 +77,18 @@ struct DrawLines {
 	std::vector< Vertex > attribs;
 
 };
+
+struct DrawLines::TextCache {
+	static constexpr uint32_t Capacity = 64;
+	void clear() { entries.clear(); }
+
+	uint32_t hits = 0, misses = 0; //(draw_text calls that were / weren't just a copy)
+
+	//internals:
+	struct Entry {
+		glm::vec3 x, y; //text size and direction the entry was laid out with
+		glm::vec3 advance; //anchor_out - anchor
+		std::vector< glm::vec3 > offsets; //line vertex positions, relative to the anchor
+	};
+	std::unordered_map< std::string, Entry > entries;
+};
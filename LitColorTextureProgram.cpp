@@ -43,10 +43,49 @@ Load< LitColorTextureProgram > lit_color_texture_program(LoadTagEarly, []() -> L
 	return ret;
 });
 
-LitColorTextureProgram::LitColorTextureProgram() {
+//(n.b. loaded after lit_color_texture_program, since it's later in the file)
+Load< LitColorTextureProgram > lit_color_texture_program_instanced(LoadTagEarly, []() -> LitColorTextureProgram const * {
+	LitColorTextureProgram *ret = new LitColorTextureProgram(true);
+
+	//----- add to the pipeline template -----
+	lit_color_texture_program_pipeline.instanced.program = ret->program;
+
+	lit_color_texture_program_pipeline.instanced.WORLD_TO_CLIP_mat4 = ret->WORLD_TO_CLIP_mat4;
+	lit_color_texture_program_pipeline.instanced.WORLD_TO_LIGHT_mat4x3 = ret->WORLD_TO_LIGHT_mat4x3;
+	lit_color_texture_program_pipeline.instanced.NORMAL_WORLD_TO_LIGHT_mat3 = ret->NORMAL_WORLD_TO_LIGHT_mat3;
+
+	return ret;
+});
+
+LitColorTextureProgram::LitColorTextureProgram(bool instanced) {
 	//Compile vertex and fragment shaders using the convenient 'gl_compile_program' helper function:
 	program = gl_compile_program(
 		//vertex shader:
+		(instanced ?
+		//instanced version -- object transforms are per-instance attributes:
+		"#version 330\n"
+		"uniform mat4 WORLD_TO_CLIP;\n"
+		"uniform mat4x3 WORLD_TO_LIGHT;\n"
+		"uniform mat3 NORMAL_WORLD_TO_LIGHT;\n"
+		"in mat4x3 OBJECT_TO_WORLD;\n"
+		"in mat3 NORMAL_TO_WORLD;\n"
+		"in vec4 Position;\n"
+		"in vec3 Normal;\n"
+		"in vec4 Color;\n"
+		"in vec2 TexCoord;\n"
+		"out vec3 position;\n"
+		"out vec3 normal;\n"
+		"out vec4 color;\n"
+		"out vec2 texCoord;\n"
+		"void main() {\n"
+		"	vec4 world_position = vec4(OBJECT_TO_WORLD * Position, 1.0);\n"
+		"	gl_Position = WORLD_TO_CLIP * world_position;\n"
+		"	position = WORLD_TO_LIGHT * world_position;\n"
+		"	normal = NORMAL_WORLD_TO_LIGHT * (NORMAL_TO_WORLD * Normal);\n"
+		"	color = Color;\n"
+		"	texCoord = TexCoord;\n"
+		"}\n"
+		:
 		"#version 330\n"
 		"uniform mat4 OBJECT_TO_CLIP;\n"
 		"uniform mat4x3 OBJECT_TO_LIGHT;\n"
@@ -66,6 +105,7 @@ LitColorTextureProgram::LitColorTextureProgram() {
 		"	color = Color;\n"
 		"	texCoord = TexCoord;\n"
 		"}\n"
+		)
 	,
 		//fragment shader:
 		"#version 330\n"
@@ -114,11 +154,17 @@ LitColorTextureProgram::LitColorTextureProgram() {
 	Normal_vec3 = glGetAttribLocation(program, "Normal");
 	Color_vec4 = glGetAttribLocation(program, "Color");
 	TexCoord_vec2 = glGetAttribLocation(program, "TexCoord");
+	OBJECT_TO_WORLD_mat4x3 = glGetAttribLocation(program, "OBJECT_TO_WORLD");
+	NORMAL_TO_WORLD_mat3 = glGetAttribLocation(program, "NORMAL_TO_WORLD");
 
 	//look up the locations of uniforms:
+	// (n.b. locations of uniforms not in this version of the program will be -1U)
 	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
 	OBJECT_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "OBJECT_TO_LIGHT");
 	NORMAL_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_TO_LIGHT");
+	WORLD_TO_CLIP_mat4 = glGetUniformLocation(program, "WORLD_TO_CLIP");
+	WORLD_TO_LIGHT_mat4x3 = glGetUniformLocation(program, "WORLD_TO_LIGHT");
+	NORMAL_WORLD_TO_LIGHT_mat3 = glGetUniformLocation(program, "NORMAL_WORLD_TO_LIGHT");
 
 	LIGHT_TYPE_int = glGetUniformLocation(program, "LIGHT_TYPE");
 	LIGHT_LOCATION_vec3 = glGetUniformLocation(program, "LIGHT_LOCATION");
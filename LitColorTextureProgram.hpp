@@ -5,8 +5,9 @@
 #include "Scene.hpp"
 
 //Shader program that draws transformed, lit, textured vertices tinted with vertex colors:
+// (the 'instanced' version reads object transforms from per-instance attributes; see Scene::Drawable::Pipeline::Instanced)
 struct LitColorTextureProgram {
-	LitColorTextureProgram();
+	LitColorTextureProgram(bool instanced = false);
 	~LitColorTextureProgram();
 
 	GLuint program = 0;
@@ -16,11 +17,18 @@ struct LitColorTextureProgram {
 	GLuint Normal_vec3 = -1U;
 	GLuint Color_vec4 = -1U;
 	GLuint TexCoord_vec2 = -1U;
+	//(instanced version only:)
+	GLuint OBJECT_TO_WORLD_mat4x3 = -1U; //per-instance
+	GLuint NORMAL_TO_WORLD_mat3 = -1U; //per-instance
 
 	//Uniform (per-invocation variable) locations:
 	GLuint OBJECT_TO_CLIP_mat4 = -1U;
 	GLuint OBJECT_TO_LIGHT_mat4x3 = -1U;
 	GLuint NORMAL_TO_LIGHT_mat3 = -1U;
+	//(instanced version uses these instead of the above:)
+	GLuint WORLD_TO_CLIP_mat4 = -1U;
+	GLuint WORLD_TO_LIGHT_mat4x3 = -1U;
+	GLuint NORMAL_WORLD_TO_LIGHT_mat3 = -1U;
 
 	//lighting:
 	GLuint LIGHT_TYPE_int = -1U;
@@ -34,7 +42,10 @@ struct LitColorTextureProgram {
 };
 
 extern Load< LitColorTextureProgram > lit_color_texture_program;
+extern Load< LitColorTextureProgram > lit_color_texture_program_instanced;
 
 //For convenient scene-graph setup, copy this object:
 // NOTE: by default, has texture bound to 1-pixel white texture -- so it's okay to use with vertex-color-only meshes.
+// NOTE: pipeline.instanced is set up to use lit_color_texture_program_instanced, except for 'vao' --
+//  set pipeline.instanced.vao to a vertex array made with Scene::make_instance_vao() to allow instancing.
 extern Scene::Drawable::Pipeline lit_color_texture_program_pipeline;
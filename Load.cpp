@@ -1,20 +1,124 @@
 #include "Load.hpp"
+#include "Profiler.hpp"
 
+#include <algorithm>
 #include <array>
-#include <list>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
+	struct LoadJob {
+		void const *id = nullptr;
+		std::vector< void const * > dependencies;
+		bool in_order = false; //(added by add_load_function) also depends on every job added before it in the same tag
+		std::function< void() > work; //called on a worker thread
+		std::function< void() > finish; //called on the main thread
+	};
+
+	std::array< std::vector< LoadJob >, MaxLoadTag > &get_load_lists() {
+		static std::array< std::vector< LoadJob >, MaxLoadTag > load_lists;
 		return load_lists;
 	}
+
+	//Worker threads that call the 'work' functions of jobs:
+	struct WorkerPool {
+		WorkerPool(uint32_t count) {
+			for (uint32_t i = 0; i < count; ++i) {
+				threads.emplace_back([this,i](){
+					Profiler::set_thread_name("load worker " + std::to_string(i));
+					std::unique_lock< std::mutex > lock(mutex);
+					while (true) {
+						work_cv.wait(lock, [this](){ return quit || !queued.empty(); });
+						if (quit) break;
+						auto [job, work] = queued.front();
+						queued.pop_front();
+						lock.unlock();
+						std::exception_ptr error;
+						try {
+							PROFILE_ZONE("Load::work");
+							(*work)();
+						} catch (...) {
+							error = std::current_exception();
+						}
+						lock.lock();
+						done.emplace_back(job, error);
+						done_cv.notify_one();
+					}
+				});
+			}
+		}
+		//stop workers (after they finish whatever they are running):
+		~WorkerPool() {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				quit = true;
+			}
+			work_cv.notify_all();
+			for (auto &thread : threads) {
+				thread.join();
+			}
+		}
+
+		//(main thread) queue a job's work:
+		void run(uint32_t job, std::function< void() > const *work) {
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				queued.emplace_back(job, work);
+				++pending;
+			}
+			work_cv.notify_one();
+		}
+
+		//(main thread) wait for some queued work to complete and return its job; rethrows if the work threw:
+		uint32_t wait() {
+			assert(pending > 0);
+			std::unique_lock< std::mutex > lock(mutex);
+			done_cv.wait(lock, [this](){ return !done.empty(); });
+			auto [job, error] = done.front();
+			done.pop_front();
+			--pending;
+			if (error) std::rethrow_exception(error);
+			return job;
+		}
+
+		uint32_t pending = 0; //queued + running + done-but-not-waited-for work (only used by main thread)
+
+		std::mutex mutex;
+		std::condition_variable work_cv; //signaled when work is queued (or pool is stopping)
+		std::condition_variable done_cv; //signaled when work completes
+		std::deque< std::pair< uint32_t, std::function< void() > const * > > queued;
+		std::deque< std::pair< uint32_t, std::exception_ptr > > done;
+		bool quit = false;
+		std::vector< std::thread > threads;
+	};
 }
 
-void add_load_function(LoadTag tag, std::function< void() > const &fn) {
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *id) {
 	auto &load_lists = get_load_lists();
 	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	LoadJob job;
+	job.id = id;
+	job.in_order = true;
+	job.finish = fn;
+	load_lists[tag].emplace_back(job);
+}
+
+void add_load_job(LoadTag tag, void const *id, std::vector< void const * > const &dependencies,
+	std::function< void() > const &work, std::function< void() > const &finish) {
+	auto &load_lists = get_load_lists();
+	assert(tag < load_lists.size());
+	LoadJob job;
+	job.id = id;
+	job.dependencies = dependencies;
+	job.work = work;
+	job.finish = finish;
+	load_lists[tag].emplace_back(job);
 }
 
 void call_load_functions() {
@@ -22,11 +126,94 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
+	PROFILE_ZONE("call_load_functions");
+
 	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+
+	//figure out where each named job lives, so dependencies can be looked up:
+	std::unordered_map< void const *, std::pair< uint32_t, uint32_t > > job_locations; //id -> (tag, index)
+	bool any_work = false;
+	for (uint32_t tag = 0; tag < load_lists.size(); ++tag) {
+		for (uint32_t j = 0; j < load_lists[tag].size(); ++j) {
+			LoadJob const &job = load_lists[tag][j];
+			if (job.id) job_locations.emplace(job.id, std::make_pair(tag, j));
+			if (job.work) any_work = true;
+		}
+	}
+
+	//workers for the 'work' part of jobs:
+	// (the main thread is mostly waiting, so use one worker per core)
+	std::unique_ptr< WorkerPool > pool;
+	if (any_work) {
+		pool.reset(new WorkerPool(std::max(1U, std::thread::hardware_concurrency())));
+	}
+
+	//tags are loaded one after another; jobs within a tag are started as soon as their dependencies are loaded:
+	for (uint32_t tag = 0; tag < load_lists.size(); ++tag) {
+		std::vector< LoadJob > &jobs = load_lists[tag];
+
+		std::vector< uint32_t > waiting_on(jobs.size(), 0); //number of unloaded dependencies
+		std::vector< std::vector< uint32_t > > dependents(jobs.size());
+		auto add_dependency = [&](uint32_t job, uint32_t on) {
+			dependents[on].emplace_back(job);
+			waiting_on[job] += 1;
+		};
+
+		uint32_t last_in_order = -1U;
+		for (uint32_t j = 0; j < jobs.size(); ++j) {
+			for (void const *id : jobs[j].dependencies) {
+				auto f = job_locations.find(id);
+				if (f == job_locations.end()) {
+					throw std::runtime_error("Load depends on something that was never added as a load.");
+				}
+				if (f->second.first > tag) {
+					throw std::runtime_error("Load depends on a load with a later tag.");
+				}
+				if (f->second.first == tag) add_dependency(j, f->second.second);
+				//(loads with earlier tags are already done)
+			}
+			if (jobs[j].in_order) {
+				//depend on everything since the previous in-order job (which, in turn, depends on everything before it):
+				for (uint32_t i = (last_in_order == -1U ? 0 : last_in_order); i < j; ++i) {
+					if (i == last_in_order || !jobs[i].in_order) add_dependency(j, i);
+				}
+				last_in_order = j;
+			}
 		}
+
+		std::deque< uint32_t > ready_to_finish; //jobs whose 'work' is done
+		auto start = [&](uint32_t j) {
+			if (jobs[j].work) pool->run(j, &jobs[j].work);
+			else ready_to_finish.emplace_back(j);
+		};
+		for (uint32_t j = 0; j < jobs.size(); ++j) {
+			if (waiting_on[j] == 0) start(j);
+		}
+
+		uint32_t finished = 0;
+		while (finished < jobs.size()) {
+			if (ready_to_finish.empty()) {
+				if (!pool || pool->pending == 0) {
+					throw std::runtime_error("Load dependencies contain a cycle.");
+				}
+				ready_to_finish.emplace_back(pool->wait());
+			}
+			uint32_t j = ready_to_finish.front();
+			ready_to_finish.pop_front();
+
+			if (jobs[j].finish) {
+				PROFILE_ZONE("Load::finish");
+				jobs[j].finish();
+			}
+			finished += 1;
+
+			for (uint32_t d : dependents[j]) {
+				assert(waiting_on[d] > 0);
+				waiting_on[d] -= 1;
+				if (waiting_on[d] == 0) start(d);
+			}
+		}
+
+		jobs.clear();
 	}
 }
@@ -20,10 +20,29 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Loading can also be split into two steps, so that slow work (reading files, decoding, parsing)
+ *  runs in parallel on worker threads while OpenGL calls stay on the main thread:
+ *
+ * Load< MeshBuffer > main_meshes(LoadTagDefault, []() -> MeshBuffer * {
+ *     return new MeshBuffer(data_path("main.pnct"), MeshBuffer::DeferUpload); //on a worker thread
+ * }, [](MeshBuffer &buffer) {
+ *     buffer.upload(); //on the main thread
+ * });
+ *
+ * Two-step loads run as soon as the loads they depend on are finished, rather than in order:
+ *
+ * Load< Scene > main_scene(LoadTagDefault, []() -> Scene * {
+ *     return new Scene(data_path("main.scene"), ... uses main_meshes->lookup() ...);
+ * }, nullptr, { &main_meshes });
+ *
+ * (one-step loads still run in order, after everything added before them in the same tag has loaded)
+ *
  */
 
 #include <functional>
+#include <memory>
 #include <stdexcept>
+#include <vector>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
@@ -34,7 +53,17 @@ enum LoadTag : uint32_t {
 
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
-void add_load_function(LoadTag tag, std::function< void() > const &fn);
+// (the function will be called on the main thread after all functions added earlier with the same tag)
+// 'id' is optional, and can be used to name this function in other loads' dependencies
+void add_load_function(LoadTag tag, std::function< void() > const &fn, void const *id = nullptr);
+
+//Add a two-step loading job:
+// 'work' is called on a worker thread (so must not use OpenGL) once all of 'dependencies' have loaded;
+// 'finish' is called on the main thread after 'work' returns.
+// (either function may be empty; dependencies are 'id's of loads with the same or earlier tags)
+// (only call *before* "call_load_functions()")
+void add_load_job(LoadTag tag, void const *id, std::vector< void const * > const &dependencies,
+	std::function< void() > const &work, std::function< void() > const &finish);
 
 //Call all loading functions:
 // (loading functions may throw exceptions if they fail.)
@@ -55,6 +84,22 @@ struct Load {
 			if (!(this->value)) {
 				throw std::runtime_error("Loading failed.");
 			}
+		}, this);
+	}
+
+	//Constructing a Load< T > with a 'work' and 'finish' function adds a two-step job:
+	// work_fn is called on a worker thread, finish_fn (if not empty) is called on the main thread with the result.
+	// 'dependencies' are the addresses of other Load<>s that must be loaded before work_fn is called.
+	Load(LoadTag tag, const std::function< T *() > &work_fn, const std::function< void(T &) > &finish_fn, std::vector< void const * > const &dependencies = {}) : value(nullptr) {
+		auto loaded = std::make_shared< T * >(nullptr); //result of work_fn, waiting for finish_fn
+		add_load_job(tag, this, dependencies, [loaded,work_fn](){
+			*loaded = work_fn();
+			if (!(*loaded)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		}, [this,loaded,finish_fn](){
+			if (finish_fn) finish_fn(**loaded);
+			this->value = *loaded;
 		});
 	}
 
@@ -74,7 +119,7 @@ template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
 	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+		add_load_function(tag, load_fn, this);
 	}
 };
 
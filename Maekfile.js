@@ -123,10 +123,14 @@ if (maek.OS === 'windows') {
 //returns objFile: objFileBase + a platform-dependant suffix ('.o' or '.obj')
 const game_names = [
 	maek.CPP('PlayMode.cpp'),
+	maek.CPP('SpatialHash.cpp'),
+	maek.CPP('step_turtles.cpp'),
+	maek.CPP('StatsOverlay.cpp'),
 	maek.CPP('main.cpp'),
 	maek.CPP('LitColorTextureProgram.cpp'),
 	//maek.CPP('ColorTextureProgram.cpp'),  //not used right now, but you might want it
 	maek.CPP('Sound.cpp'),
+	maek.CPP('mix_mono_to_stereo.cpp'),
 	maek.CPP('load_wav.cpp'),
 	maek.CPP('load_opus.cpp')
 ];
@@ -138,12 +142,18 @@ const common_names = [
 	maek.CPP('DrawLines.cpp'),
 	maek.CPP('ColorProgram.cpp'),
 	maek.CPP('Scene.cpp'),
+	maek.CPP('BVH.cpp'),
 	maek.CPP('Mesh.cpp'),
+	maek.CPP('MeshData.cpp'),
+	maek.CPP('MeshData-optimize.cpp'),
+	maek.CPP('ChunkFile.cpp'),
 	maek.CPP('load_save_png.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
 	maek.CPP('Mode.cpp'),
 	maek.CPP('GL.cpp'),
-	maek.CPP('Load.cpp')
+	maek.CPP('Load.cpp'),
+	maek.CPP('Profiler.cpp'),
+	maek.CPP('Profiler-GL.cpp')
 ];
 
 const show_meshes_names = [
@@ -158,6 +168,32 @@ const show_scene_names = [
 	maek.CPP('ShowSceneMode.cpp')
 ];
 
+const pnct_tool_names = [
+	maek.CPP('pnct-tool.cpp'),
+	maek.CPP('MeshData.cpp'),
+	maek.CPP('MeshData-optimize.cpp'),
+	maek.CPP('ChunkFile.cpp')
+];
+
+const bench_sound_names = [
+	maek.CPP('bench-sound.cpp'),
+	maek.CPP('Sound.cpp'),
+	maek.CPP('mix_mono_to_stereo.cpp'),
+	maek.CPP('load_wav.cpp'),
+	maek.CPP('load_opus.cpp'),
+	maek.CPP('Profiler.cpp')
+];
+
+const bench_mix_names = [
+	maek.CPP('bench-mix.cpp'),
+	maek.CPP('mix_mono_to_stereo.cpp')
+];
+
+const bench_turtles_names = [
+	maek.CPP('bench-turtles.cpp'),
+	maek.CPP('step_turtles.cpp')
+];
+
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
@@ -165,9 +201,13 @@ const show_scene_names = [
 const game_exe = maek.LINK([...game_names, ...common_names], 'dist/game');
 const show_meshes_exe = maek.LINK([...show_meshes_names, ...common_names], 'scenes/show-meshes');
 const show_scene_exe = maek.LINK([...show_scene_names, ...common_names], 'scenes/show-scene');
+const pnct_tool_exe = maek.LINK(pnct_tool_names, 'scenes/pnct-tool', { LINKLibs: [] }); //(offline tool doesn't need any libraries)
+const bench_sound_exe = maek.LINK(bench_sound_names, 'bench/bench-sound');
+const bench_mix_exe = maek.LINK(bench_mix_names, 'bench/bench-mix', { LINKLibs: [] }); //(kernel benchmark doesn't need any libraries)
+const bench_turtles_exe = maek.LINK(bench_turtles_names, 'bench/bench-turtles', { LINKLibs: [] });
 
 //set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, ...copies];
+maek.TARGETS = [game_exe, show_meshes_exe, show_scene_exe, pnct_tool_exe, ...copies];
 
 //the '[targets =] RULE(targets, prerequisites[, recipe])' rule defines a Makefile-style task
 // targets: array of targets the task produces (can include both files and ':abstract targets')
@@ -178,6 +218,17 @@ maek.RULE([':run'], [game_exe], [
 	[game_exe, '--some-command-line-option']
 ]);
 
+//benchmarks aren't built by default; build + run them with, e.g., 'node Maekfile.js :bench-mix':
+maek.RULE([':bench-mix'], [bench_mix_exe], [
+	[bench_mix_exe]
+]);
+maek.RULE([':bench-sound'], [bench_sound_exe], [
+	[bench_sound_exe]
+]);
+maek.RULE([':bench-turtles'], [bench_turtles_exe], [
+	[bench_turtles_exe]
+]);
+
 //Note that tasks that produce ':abstract targets' are never cached.
 // This is similar to how .PHONY targets behave in make.
 
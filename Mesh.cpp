@@ -1,5 +1,5 @@
 #include "Mesh.hpp"
-#include "read_write_chunk.hpp"
+#include "MeshData.hpp"
 
 #include <glm/glm.hpp>
 
@@ -10,81 +10,115 @@
 #include <string>
 #include <set>
 #include <cstddef>
+#include <cstring>
+#include <cassert>
 
-MeshBuffer::MeshBuffer(std::string const &filename) {
-	glGenBuffers(1, &buffer);
-
-	std::ifstream file(filename, std::ios::binary);
-
-	GLuint total = 0;
-
-	struct Vertex {
-		glm::vec3 Position;
-		glm::vec3 Normal;
-		glm::u8vec4 Color;
-		glm::vec2 TexCoord;
-	};
-	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
-	std::vector< Vertex > data;
+MeshBuffer::MeshBuffer(std::string const &filename, uint32_t flags) : MeshBuffer(filename, DeferUpload, flags) {
+	upload();
+}
 
-	//read + upload data chunk:
-	if (filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct") {
-		read_chunk(file, "pnct", &data);
+MeshBuffer::MeshBuffer(std::string const &filename, DeferUpload_t, uint32_t flags) {
+	if (!(filename.size() >= 5 && filename.substr(filename.size()-5) == ".pnct")) {
+		throw std::runtime_error("Unknown file type '" + filename + "'");
+	}
 
-		//upload data:
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(Vertex), data.data(), GL_STATIC_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	typedef MeshData::Vertex Vertex;
+	std::vector< MeshData::Mesh > entries;
+	std::vector< MeshData::Bounds > bounds; //(from the file, if it has them, so that vertex data isn't read here)
+	Vertex const *vertices = nullptr; //(full-precision vertices, for computing bounds otherwise)
+	GLenum index_type = GL_NONE;
+
+	MeshData data;
+	if (flags == 0) {
+		//the file can be uploaded as-is, so upload() will read vertices and indices straight from the file's mapping:
+		pending_file.reset(new ChunkFile(filename));
+		MeshData::View view = MeshData::view(*pending_file);
+		pending_data = ChunkFile::Span< uint8_t >(reinterpret_cast< uint8_t const * >(view.vertices.data()), view.vertices.size() * sizeof(Vertex));
+		pending_index_data = view.index_data;
+		if (view.index_size == 2) index_type = GL_UNSIGNED_SHORT;
+		if (view.index_size == 4) index_type = GL_UNSIGNED_INT;
+		entries = std::move(view.meshes);
+		bounds.assign(view.bounds.begin(), view.bounds.end());
+		vertices = view.vertices.data();
+	} else {
+		//otherwise, processed data is kept in pending_storage and pending_index_storage:
+		data.read(filename);
+		if (flags & Optimize) data.optimize();
+
+		if (flags & Quantize) {
+			std::vector< MeshData::PackedVertex > packed = data.pack();
+			pending_storage.resize(packed.size() * sizeof(MeshData::PackedVertex));
+			std::memcpy(pending_storage.data(), packed.data(), pending_storage.size());
+		} else {
+			pending_storage.resize(data.vertices.size() * sizeof(Vertex));
+			std::memcpy(pending_storage.data(), data.vertices.data(), pending_storage.size());
+		}
+		pending_data = ChunkFile::Span< uint8_t >(pending_storage.data(), pending_storage.size());
+
+		//indices (if any) are uploaded as 16-bit values when they all fit:
+		if (data.indexed) {
+			if (data.vertices.size() <= 0x10000) {
+				index_type = GL_UNSIGNED_SHORT;
+				std::vector< uint16_t > indices16(data.indices.begin(), data.indices.end());
+				pending_index_storage.resize(indices16.size() * sizeof(uint16_t));
+				std::memcpy(pending_index_storage.data(), indices16.data(), pending_index_storage.size());
+			} else {
+				index_type = GL_UNSIGNED_INT;
+				pending_index_storage.resize(data.indices.size() * sizeof(uint32_t));
+				std::memcpy(pending_index_storage.data(), data.indices.data(), pending_index_storage.size());
+			}
+			pending_index_data = ChunkFile::Span< uint8_t >(pending_index_storage.data(), pending_index_storage.size());
+		}
 
-		total = GLuint(data.size()); //store total for later checks on index
+		entries = data.meshes;
+		vertices = data.vertices.data();
+	}
 
-		//store attrib locations:
+	//store attrib locations:
+	if (flags & Quantize) {
+		typedef MeshData::PackedVertex PackedVertex;
+		Position = Attrib(3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), offsetof(PackedVertex, Position));
+		Normal = Attrib(4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), offsetof(PackedVertex, Normal));
+		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedVertex), offsetof(PackedVertex, Color));
+		TexCoord = Attrib(2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), offsetof(PackedVertex, TexCoord));
+	} else {
 		Position = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Position));
 		Normal = Attrib(3, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, Normal));
 		Color = Attrib(4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex), offsetof(Vertex, Color));
 		TexCoord = Attrib(2, GL_FLOAT, GL_FALSE, sizeof(Vertex), offsetof(Vertex, TexCoord));
-	} else {
-		throw std::runtime_error("Unknown file type '" + filename + "'");
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
-
-	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_begin, vertex_end;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
-
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
-
-		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-				throw std::runtime_error("index entry has out-of-range name begin/end");
-			}
-			if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= total)) {
-				throw std::runtime_error("index entry has out-of-range vertex start/count");
-			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-			Mesh mesh;
-			mesh.type = GL_TRIANGLES;
+	//add meshes:
+	for (uint32_t e = 0; e < entries.size(); ++e) {
+		MeshData::Mesh const &entry = entries[e];
+		Mesh mesh;
+		mesh.type = GL_TRIANGLES;
+		if (index_type != GL_NONE) {
+			mesh.start = entry.index_begin;
+			mesh.count = entry.index_end - entry.index_begin;
+			mesh.index_type = index_type;
+		} else {
 			mesh.start = entry.vertex_begin;
 			mesh.count = entry.vertex_end - entry.vertex_begin;
+		}
+		if (!bounds.empty()) {
+			mesh.min = bounds[e].min;
+			mesh.max = bounds[e].max;
+		} else {
 			for (uint32_t v = entry.vertex_begin; v < entry.vertex_end; ++v) {
-				mesh.min = glm::min(mesh.min, data[v].Position);
-				mesh.max = glm::max(mesh.max, data[v].Position);
-			}
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+				mesh.min = glm::min(mesh.min, vertices[v].Position);
+				mesh.max = glm::max(mesh.max, vertices[v].Position);
 			}
 		}
-	}
-
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" << filename << "'" << std::endl;
+		if ((flags & Quantize) && mesh.min.x <= mesh.max.x) {
+			//(as in MeshData::pack())
+			mesh.position_scale = mesh.max - mesh.min;
+			mesh.position_offset = mesh.min;
+		}
+		bool inserted = meshes.insert(std::make_pair(entry.name, mesh)).second;
+		if (!inserted) {
+			std::cerr << "WARNING: mesh name '" + entry.name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		}
 	}
 
 	/* //DEBUG:
@@ -98,6 +132,31 @@ MeshBuffer::MeshBuffer(std::string const &filename) {
 	*/
 }
 
+void MeshBuffer::upload() {
+	assert(buffer == 0 && "upload() should only be called once");
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, pending_data.size(), pending_data.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (!pending_index_data.empty()) {
+		glGenBuffers(1, &index_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, pending_index_data.size(), pending_index_data.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	//free the CPU-side data (and unmap the file):
+	pending_data = ChunkFile::Span< uint8_t >();
+	pending_index_data = ChunkFile::Span< uint8_t >();
+	pending_file.reset();
+	pending_storage.clear();
+	pending_storage.shrink_to_fit();
+	pending_index_storage.clear();
+	pending_index_storage.shrink_to_fit();
+}
+
 const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	auto f = meshes.find(name);
 	if (f == meshes.end()) {
@@ -106,10 +165,11 @@ const Mesh &MeshBuffer::lookup(std::string const &name) const {
 	return f->second;
 }
 
-GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
-	//create a new vertex array object:
-	GLuint vao = 0;
-	glGenVertexArrays(1, &vao);
+GLuint MeshBuffer::make_vao_for_program(GLuint program, GLuint vao) const {
+	assert(buffer != 0 && "MeshBuffer should be uploaded before making a vao");
+
+	//create a new vertex array object (if not adding to an existing one):
+	if (vao == 0) glGenVertexArrays(1, &vao);
 	glBindVertexArray(vao);
 
 	//Try to bind all attributes in this buffer:
@@ -128,9 +188,11 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 	bind_attribute("Color", Color);
 	bind_attribute("TexCoord", TexCoord);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glBindVertexArray(0);
 
-	//Check that all active attributes were bound:
+	//indexed meshes also need the index buffer (which is part of the vao's state):
+	if (index_buffer != 0) glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_buffer);
+
+	//Check that all active attributes were bound (here, or already in the vao):
 	GLint active = 0;
 	glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &active);
 	assert(active >= 0 && "Doesn't makes sense to have negative active attributes.");
@@ -142,9 +204,15 @@ GLuint MeshBuffer::make_vao_for_program(GLuint program) const {
 		name[99] = '\0';
 		GLint location = glGetAttribLocation(program, name);
 		if (!bound.count(GLuint(location))) {
-			throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+			GLint enabled = GL_FALSE;
+			glGetVertexAttribiv(GLuint(location), GL_VERTEX_ATTRIB_ARRAY_ENABLED, &enabled);
+			if (enabled == GL_FALSE) {
+				glBindVertexArray(0);
+				throw std::runtime_error("ERROR: active attribute '" + std::string(name) + "' in program is not bound.");
+			}
 		}
 	}
+	glBindVertexArray(0);
 
 	return vao;
 }
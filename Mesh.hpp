@@ -1,8 +1,8 @@
 #pragma once
 
 /*
- * In this code, "Mesh" is a range of vertices that should be sent through
- *  the OpenGL pipeline together.
+ * In this code, "Mesh" is a range of vertices (or of indices into the vertices)
+ *  that should be sent through the OpenGL pipeline together.
  * A "MeshBuffer" holds a collection of such meshes (loaded from a file) in
  *  a single OpenGL array buffer. Individual meshes can be looked up by name
  *  using the MeshBuffer::lookup() function.
@@ -10,43 +10,82 @@
  */
 
 #include "GL.hpp"
+#include "ChunkFile.hpp"
 #include <glm/glm.hpp>
 #include <map>
+#include <memory>
 #include <limits>
 #include <string>
+#include <vector>
 
 
 struct Mesh {
-	//Meshes are vertex ranges (and primitive types) in their MeshBuffer:
+	//Meshes are vertex (or index) ranges (and primitive types) in their MeshBuffer:
 
 	GLenum type = GL_TRIANGLES; //type of primitives in mesh
-	GLuint start = 0; //index of first vertex
-	GLuint count = 0; //count of vertices
+	GLuint start = 0; //index of first vertex (or first index, for indexed meshes)
+	GLuint count = 0; //count of vertices (or indices)
+	GLenum index_type = GL_NONE; //GL_NONE for glDrawArrays, or the type of indices for glDrawElements (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT)
 
 	//Bounding box.
 	//useful for debug visualization and (perhaps, eventually) collision detection:
 	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
 	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+	//Position attributes are in object space unless the buffer was loaded with MeshBuffer::Quantize,
+	// in which case object space position = position_offset + position_scale * Position:
+	glm::vec3 position_scale = glm::vec3(1.0f);
+	glm::vec3 position_offset = glm::vec3(0.0f);
 };
 
 struct MeshBuffer {
+	//processing to do to meshes as they load (combine with '|'):
+	enum Flags : uint32_t {
+		//reorder meshes for vertex cache locality (see MeshData::optimize())
+		// -- useful for files that haven't been through 'pnct-tool --optimize':
+		Optimize = 1,
+		//store vertices in a compact format (MeshData::PackedVertex, 20 bytes instead of 36):
+		// note: drawables must copy Mesh::position_scale and position_offset to their pipeline
+		Quantize = 2,
+	};
+
 	//construct from a file:
 	// note: will throw if file fails to read.
-	MeshBuffer(std::string const &filename);
+	MeshBuffer(std::string const &filename, uint32_t flags = 0);
+
+	//construct from a file, but don't upload to OpenGL yet (so can be called from a worker thread):
+	// note: call upload() on the OpenGL thread before using 'buffer'.
+	enum DeferUpload_t { DeferUpload };
+	MeshBuffer(std::string const &filename, DeferUpload_t, uint32_t flags = 0);
+
+	//upload data read by the DeferUpload constructor (call once, on the OpenGL thread):
+	void upload();
 
 	//look up a particular mesh by name:
 	// note: will throw if mesh not found.
 	const Mesh &lookup(std::string const &name) const;
 	
-	//build a vertex array object that links this vbo to attributes to a program:
+	//build a vertex array object that links this vbo (and index buffer, if any) to attributes to a program:
 	// note: will throw if program defines attributes not contained in this buffer
-	GLuint make_vao_for_program(GLuint program) const;
+	// if 'vao' is given, attributes are added to it instead of a new vertex array object
+	//  (e.g., to one from Scene::make_instance_vao() that already has per-instance attributes)
+	GLuint make_vao_for_program(GLuint program, GLuint vao = 0) const;
 
 	//This is the OpenGL vertex buffer object containing the mesh data:
 	GLuint buffer = 0;
+	//...and the element array buffer containing indices (if meshes are indexed):
+	GLuint index_buffer = 0;
 
 	//-- internals ---
 
+	//vertex (and index) data read from the file but not yet uploaded (cleared by upload()):
+	// (points into pending_file's mapping when the file is uploaded as-is, or into pending_*storage when it was processed)
+	ChunkFile::Span< uint8_t > pending_data;
+	ChunkFile::Span< uint8_t > pending_index_data;
+	std::unique_ptr< ChunkFile > pending_file;
+	std::vector< uint8_t > pending_storage;
+	std::vector< uint8_t > pending_index_storage;
+
 	//used by the lookup() function:
 	std::map< std::string, Mesh > meshes;
 
@@ -0,0 +1,271 @@
+//MeshData::optimize() and MeshData::cache_stats() -- see MeshData.hpp
+
+#include "MeshData.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+namespace {
+	//Order the triangles of 'indices' (values in [0, vertex_count)) for post-transform vertex cache reuse,
+	// as in Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" (2006):
+	// each vertex gets a score from its position in a simulated LRU cache and how many triangles still use it,
+	// and the triangle with the highest total score is drawn next.
+	std::vector< uint32_t > order_for_cache(std::vector< uint32_t > const &indices, uint32_t vertex_count) {
+		constexpr uint32_t CacheSize = 32;
+		constexpr float CacheDecayPower = 1.5f;
+		constexpr float LastTriangleScore = 0.75f;
+		constexpr float ValenceBoostScale = 2.0f;
+		constexpr float ValenceBoostPower = 0.5f;
+
+		uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+		//triangles using each vertex (triangles are removed as they are drawn):
+		std::vector< uint32_t > first_use(vertex_count + 1, 0);
+		for (uint32_t v : indices) first_use[v + 1] += 1;
+		for (uint32_t v = 0; v < vertex_count; ++v) first_use[v + 1] += first_use[v];
+		std::vector< uint32_t > remaining(vertex_count, 0); //number of not-yet-drawn triangles using each vertex
+		std::vector< uint32_t > uses(indices.size());
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t i = 0; i < 3; ++i) {
+				uint32_t v = indices[3*t+i];
+				uses[first_use[v] + remaining[v]] = t;
+				remaining[v] += 1;
+			}
+		}
+
+		std::vector< int32_t > cache_position(vertex_count, -1);
+		auto vertex_score = [&](uint32_t v) {
+			if (remaining[v] == 0) return -1.0f; //(no triangles left to draw)
+			float score = 0.0f;
+			int32_t position = cache_position[v];
+			if (position >= 0) {
+				if (position < 3) {
+					//(used by the last triangle, so drawing its neighbors doesn't depend much on which vertex they share)
+					score = LastTriangleScore;
+				} else {
+					float scale = 1.0f / float(CacheSize - 3);
+					score = std::pow(1.0f - float(position - 3) * scale, CacheDecayPower);
+				}
+			}
+			//boost vertices with few triangles left, to finish them off:
+			score += ValenceBoostScale * std::pow(float(remaining[v]), -ValenceBoostPower);
+			return score;
+		};
+
+		std::vector< float > scores(vertex_count);
+		for (uint32_t v = 0; v < vertex_count; ++v) scores[v] = vertex_score(v);
+		std::vector< float > triangle_scores(triangle_count);
+		std::vector< bool > drawn(triangle_count, false);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			triangle_scores[t] = scores[indices[3*t+0]] + scores[indices[3*t+1]] + scores[indices[3*t+2]];
+		}
+
+		std::vector< uint32_t > cache, next_cache;
+		cache.reserve(CacheSize + 3);
+		next_cache.reserve(CacheSize + 3);
+
+		std::vector< uint32_t > ordered;
+		ordered.reserve(indices.size());
+		uint32_t best = -1U;
+		uint32_t next_undrawn = 0; //(no triangles before this one are left to draw)
+		while (ordered.size() < indices.size()) {
+			if (best == -1U) {
+				//nothing good in the cache -- start over at any triangle that hasn't been drawn:
+				while (drawn[next_undrawn]) ++next_undrawn;
+				best = next_undrawn;
+			}
+
+			//draw the best triangle:
+			drawn[best] = true;
+			uint32_t const *tri = &indices[3*best];
+			ordered.insert(ordered.end(), tri, tri + 3);
+			for (uint32_t i = 0; i < 3; ++i) {
+				uint32_t v = tri[i];
+				uint32_t *begin = &uses[first_use[v]];
+				uint32_t *end = begin + remaining[v];
+				*std::find(begin, end, best) = *(end - 1);
+				remaining[v] -= 1;
+			}
+
+			//its vertices go to the front of the cache:
+			next_cache.assign(tri, tri + 3);
+			for (uint32_t v : cache) {
+				if (v != tri[0] && v != tri[1] && v != tri[2]) next_cache.emplace_back(v);
+			}
+			std::swap(cache, next_cache);
+
+			//update scores of everything in (or just pushed out of) the cache, and find the best triangle using them:
+			for (uint32_t p = 0; p < cache.size(); ++p) {
+				cache_position[cache[p]] = (p < CacheSize ? int32_t(p) : -1);
+			}
+			for (uint32_t v : cache) {
+				float score = vertex_score(v);
+				float change = score - scores[v];
+				scores[v] = score;
+				for (uint32_t u = first_use[v]; u < first_use[v] + remaining[v]; ++u) {
+					triangle_scores[uses[u]] += change;
+				}
+			}
+			best = -1U;
+			float best_score = -1.0f;
+			for (uint32_t p = 0; p < cache.size() && p < CacheSize; ++p) {
+				uint32_t v = cache[p];
+				for (uint32_t u = first_use[v]; u < first_use[v] + remaining[v]; ++u) {
+					uint32_t t = uses[u];
+					if (triangle_scores[t] > best_score) {
+						best_score = triangle_scores[t];
+						best = t;
+					}
+				}
+			}
+			if (cache.size() > CacheSize) cache.resize(CacheSize);
+		}
+
+		return ordered;
+	}
+
+	//Order runs of triangles (from order_for_cache) to reduce overdraw, roughly as in Sander, Nehab, and Barczak's
+	// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (2007):
+	// the triangle order is split into clusters where the vertex cache would start over anyway (so the split costs little),
+	// then clusters that face outward from the mesh's center are drawn first, since they tend to hide the others.
+	std::vector< uint32_t > order_for_overdraw(std::vector< uint32_t > const &indices, std::vector< MeshData::Vertex > const &vertices, uint32_t vertex_begin) {
+		constexpr uint32_t MinClusterTriangles = 32; //(shorter clusters would make for more vertex cache restarts)
+		constexpr uint32_t CacheSize = 16;
+
+		uint32_t triangle_count = uint32_t(indices.size() / 3);
+		auto position = [&](uint32_t i) -> glm::vec3 const & {
+			return vertices[vertex_begin + indices[i]].Position;
+		};
+
+		//split into clusters at triangles that miss the (simulated FIFO) cache on every vertex:
+		std::vector< uint32_t > cluster_starts; //first triangle of each cluster
+		{
+			std::vector< uint32_t > cache(CacheSize, -1U);
+			uint32_t next = 0;
+			for (uint32_t t = 0; t < triangle_count; ++t) {
+				uint32_t misses = 0;
+				for (uint32_t i = 0; i < 3; ++i) {
+					uint32_t v = indices[3*t+i];
+					if (std::find(cache.begin(), cache.end(), v) == cache.end()) {
+						cache[next] = v;
+						next = (next + 1) % CacheSize;
+						misses += 1;
+					}
+				}
+				if (t == 0 || (misses == 3 && t - cluster_starts.back() >= MinClusterTriangles)) {
+					cluster_starts.emplace_back(t);
+				}
+			}
+		}
+		if (cluster_starts.size() <= 1) return indices;
+		cluster_starts.emplace_back(triangle_count);
+
+		//find the mesh's center:
+		glm::vec3 mesh_center = glm::vec3(0.0f);
+		for (uint32_t i = 0; i < indices.size(); ++i) mesh_center += position(i);
+		mesh_center /= float(indices.size());
+
+		//score clusters by how much they face away from the center:
+		struct Cluster {
+			uint32_t begin, end; //triangles
+			float outward;
+		};
+		std::vector< Cluster > clusters;
+		for (uint32_t c = 0; c + 1 < cluster_starts.size(); ++c) {
+			Cluster cluster;
+			cluster.begin = cluster_starts[c];
+			cluster.end = cluster_starts[c+1];
+			glm::vec3 center = glm::vec3(0.0f);
+			glm::vec3 normal = glm::vec3(0.0f); //(area-weighted)
+			for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+				glm::vec3 const &a = position(3*t+0);
+				glm::vec3 const &b = position(3*t+1);
+				glm::vec3 const &c2 = position(3*t+2);
+				center += a + b + c2;
+				normal += glm::cross(b - a, c2 - a);
+			}
+			center /= float(3 * (cluster.end - cluster.begin));
+			float length = glm::length(normal);
+			cluster.outward = (length > 0.0f ? glm::dot(center - mesh_center, normal / length) : 0.0f);
+			clusters.emplace_back(cluster);
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const &a, Cluster const &b) {
+			return a.outward > b.outward;
+		});
+
+		std::vector< uint32_t > ordered;
+		ordered.reserve(indices.size());
+		for (auto const &cluster : clusters) {
+			ordered.insert(ordered.end(), indices.begin() + 3 * cluster.begin, indices.begin() + 3 * cluster.end);
+		}
+		return ordered;
+	}
+}
+
+void MeshData::optimize() {
+	if (!indexed) weld();
+
+	std::vector< Vertex > new_vertices;
+	new_vertices.reserve(vertices.size());
+	std::vector< uint32_t > local;
+	std::vector< uint32_t > remap;
+	for (auto &mesh : meshes) {
+		uint32_t vertex_begin = uint32_t(new_vertices.size());
+		uint32_t vertex_count = mesh.vertex_end - mesh.vertex_begin;
+
+		local.assign(indices.begin() + mesh.index_begin, indices.begin() + mesh.index_end);
+		for (uint32_t &i : local) i -= mesh.vertex_begin;
+
+		if (local.size() % 3 == 0) {
+			local = order_for_cache(local, vertex_count);
+			local = order_for_overdraw(local, vertices, mesh.vertex_begin);
+		}
+
+		//renumber vertices in order of first use (dropping unused vertices):
+		remap.assign(vertex_count, -1U);
+		for (uint32_t &i : local) {
+			if (remap[i] == -1U) {
+				remap[i] = uint32_t(new_vertices.size()) - vertex_begin;
+				new_vertices.emplace_back(vertices[mesh.vertex_begin + i]);
+			}
+			i = vertex_begin + remap[i];
+		}
+		std::copy(local.begin(), local.end(), indices.begin() + mesh.index_begin);
+
+		mesh.vertex_begin = vertex_begin;
+		mesh.vertex_end = uint32_t(new_vertices.size());
+	}
+	vertices = std::move(new_vertices);
+}
+
+MeshData::CacheStats MeshData::cache_stats(uint32_t cache_size) const {
+	CacheStats stats;
+	std::vector< uint32_t > cache(cache_size);
+	std::vector< bool > used(vertices.size(), false);
+	for (auto const &mesh : meshes) {
+		//(cache starts empty for each mesh, since meshes are drawn separately)
+		std::fill(cache.begin(), cache.end(), -1U);
+		uint32_t next = 0;
+		auto use = [&](uint32_t v) {
+			if (std::find(cache.begin(), cache.end(), v) == cache.end()) {
+				cache[next] = v;
+				next = (next + 1) % cache_size;
+				stats.transforms += 1;
+			}
+			if (!used[v]) {
+				used[v] = true;
+				stats.vertices += 1;
+			}
+		};
+		if (indexed) {
+			for (uint32_t i = mesh.index_begin; i < mesh.index_end; ++i) use(indices[i]);
+			stats.triangles += (mesh.index_end - mesh.index_begin) / 3;
+		} else {
+			for (uint32_t v = mesh.vertex_begin; v < mesh.vertex_end; ++v) use(v);
+			stats.triangles += (mesh.vertex_end - mesh.vertex_begin) / 3;
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,296 @@
+#include "MeshData.hpp"
+#include "read_write_chunk.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+MeshData::View MeshData::view(ChunkFile const &file) {
+	//(chunks are looked up by magic number, so chunks this code doesn't know about are skipped)
+	View view;
+	view.vertices = file.view< Vertex >("pnct"); //(the span is made without reading any vertex data)
+
+	ChunkFile::Span< char > strings = file.view< char >("str0");
+
+	//both versions of the index chunk start the same way:
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	struct IndexedEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_begin, vertex_end;
+		uint32_t index_begin, index_end;
+	};
+	static_assert(sizeof(IndexedEntry) == 24, "Indexed entry should be packed");
+
+	//(index tables are copied if they aren't aligned, as in files with odd-length 'str0' chunks)
+	std::vector< IndexedEntry > entries;
+	if (file.find("idx0")) {
+		view.indexed = false;
+		std::vector< IndexEntry > fallback;
+		for (auto const &entry : file.view< IndexEntry >("idx0", &fallback)) {
+			entries.emplace_back(IndexedEntry{entry.name_begin, entry.name_end, entry.vertex_begin, entry.vertex_end, 0, 0});
+		}
+	} else if (file.find("idx1")) {
+		view.indexed = true;
+		std::vector< IndexedEntry > fallback;
+		ChunkFile::Span< IndexedEntry > indexed_entries = file.view< IndexedEntry >("idx1", &fallback);
+		entries.assign(indexed_entries.begin(), indexed_entries.end());
+		std::string magic = (file.find("ix16") ? "ix16" : "ix32");
+		view.index_size = (magic == "ix16" ? 2 : 4);
+		view.index_data = file.view< uint8_t >(magic);
+		if (view.index_data.size() % view.index_size != 0) {
+			throw std::runtime_error("Size of '" + magic + "' chunk in '" + file.filename + "' not divisible by index size.");
+		}
+	} else {
+		throw std::runtime_error("Expected index chunk ('idx0' or 'idx1') in mesh file '" + file.filename + "'.");
+	}
+
+	for (auto const &entry : entries) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(entry.vertex_begin <= entry.vertex_end && entry.vertex_end <= view.vertices.size())) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		Mesh mesh;
+		mesh.name = std::string(strings.data() + entry.name_begin, strings.data() + entry.name_end);
+		mesh.vertex_begin = entry.vertex_begin;
+		mesh.vertex_end = entry.vertex_end;
+		if (view.indexed) {
+			if (!(entry.index_begin <= entry.index_end && entry.index_end <= view.index_count())) {
+				throw std::runtime_error("index entry has out-of-range index start/count");
+			}
+			for (uint32_t i = entry.index_begin; i < entry.index_end; ++i) {
+				uint32_t index = view.index(i);
+				if (!(entry.vertex_begin <= index && index < entry.vertex_end)) {
+					throw std::runtime_error("mesh '" + mesh.name + "' has an index outside of its vertex range");
+				}
+			}
+			mesh.index_begin = entry.index_begin;
+			mesh.index_end = entry.index_end;
+		}
+		view.meshes.emplace_back(mesh);
+	}
+
+	//per-mesh bounds, if the file has them:
+	if (ChunkFile::Chunk const *chunk = file.find("bnd0")) {
+		view.bounds = file.view< Bounds >(*chunk, &view.bounds_fallback);
+		if (view.bounds.size() != view.meshes.size()) {
+			throw std::runtime_error("'bnd0' chunk in '" + file.filename + "' doesn't have one entry per mesh.");
+		}
+	}
+
+	return view;
+}
+
+uint32_t MeshData::View::index(size_t i) const {
+	assert(i < index_count());
+	if (index_size == 2) {
+		uint16_t index16;
+		std::memcpy(&index16, index_data.data() + 2 * i, 2);
+		return index16;
+	} else {
+		uint32_t index32;
+		std::memcpy(&index32, index_data.data() + 4 * i, 4);
+		return index32;
+	}
+}
+
+void MeshData::read(std::string const &filename) {
+	ChunkFile file(filename);
+	file.validate(); //(all the data is about to be read anyway)
+	View view = MeshData::view(file);
+
+	vertices.assign(view.vertices.begin(), view.vertices.end());
+	indexed = view.indexed;
+	indices.resize(view.index_count());
+	for (size_t i = 0; i < indices.size(); ++i) {
+		indices[i] = view.index(i);
+	}
+	meshes = std::move(view.meshes);
+}
+
+void MeshData::write(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open mesh file '" + filename + "' for writing.");
+
+	ChunkWriter writer; //(so the file gets a table of contents)
+
+	writer.add("pnct", vertices);
+
+	std::vector< char > strings;
+	std::vector< uint32_t > entries; //(idx0 or idx1 entries, flattened)
+	for (auto const &mesh : meshes) {
+		entries.emplace_back(uint32_t(strings.size()));
+		strings.insert(strings.end(), mesh.name.begin(), mesh.name.end());
+		entries.emplace_back(uint32_t(strings.size()));
+		entries.emplace_back(mesh.vertex_begin);
+		entries.emplace_back(mesh.vertex_end);
+		if (indexed) {
+			entries.emplace_back(mesh.index_begin);
+			entries.emplace_back(mesh.index_end);
+		}
+	}
+	//(padded so the chunks that follow are 4-byte aligned -- see ChunkFile.hpp)
+	while (strings.size() % 4 != 0) strings.emplace_back('\0');
+	writer.add("str0", strings);
+
+	if (!indexed) {
+		writer.add("idx0", entries);
+	} else {
+		writer.add("idx1", entries);
+		if (vertices.size() <= 0x10000) {
+			std::vector< uint16_t > indices16(indices.begin(), indices.end());
+			writer.add("ix16", indices16);
+		} else {
+			writer.add("ix32", indices);
+		}
+	}
+
+	std::vector< Bounds > mesh_bounds(meshes.size());
+	for (uint32_t i = 0; i < meshes.size(); ++i) {
+		bounds(meshes[i], &mesh_bounds[i].min, &mesh_bounds[i].max);
+	}
+	writer.add("bnd0", mesh_bounds);
+
+	writer.write(&file);
+
+	if (!file) throw std::runtime_error("Failed to write mesh file '" + filename + "'.");
+}
+
+void MeshData::weld() {
+	//vertices are compared (and hashed) bitwise:
+	struct VertexHash {
+		size_t operator()(Vertex const &v) const {
+			uint32_t words[sizeof(Vertex) / 4];
+			std::memcpy(words, &v, sizeof(Vertex));
+			uint64_t h = 0xcbf29ce484222325ULL; //(FNV-1a, a word at a time)
+			for (uint32_t w : words) h = (h ^ w) * 0x100000001b3ULL;
+			return size_t(h ^ (h >> 32));
+		}
+	};
+	struct VertexEqual {
+		bool operator()(Vertex const &a, Vertex const &b) const {
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	std::vector< Vertex > new_vertices;
+	std::vector< uint32_t > new_indices;
+	std::unordered_map< Vertex, uint32_t, VertexHash, VertexEqual > welded;
+	for (auto &mesh : meshes) {
+		//(welding within each mesh so that meshes still have their own vertex ranges)
+		welded.clear();
+		uint32_t vertex_begin = uint32_t(new_vertices.size());
+		uint32_t index_begin = uint32_t(new_indices.size());
+		auto add = [&](uint32_t v) {
+			auto res = welded.emplace(vertices[v], uint32_t(new_vertices.size()));
+			if (res.second) new_vertices.emplace_back(vertices[v]);
+			new_indices.emplace_back(res.first->second);
+		};
+		if (indexed) {
+			for (uint32_t i = mesh.index_begin; i < mesh.index_end; ++i) add(indices[i]);
+		} else {
+			for (uint32_t v = mesh.vertex_begin; v < mesh.vertex_end; ++v) add(v);
+		}
+		mesh.vertex_begin = vertex_begin;
+		mesh.vertex_end = uint32_t(new_vertices.size());
+		mesh.index_begin = index_begin;
+		mesh.index_end = uint32_t(new_indices.size());
+	}
+
+	vertices = std::move(new_vertices);
+	indices = std::move(new_indices);
+	indexed = true;
+}
+
+void MeshData::bounds(Mesh const &mesh, glm::vec3 *min_, glm::vec3 *max_) const {
+	assert(min_ && max_);
+	glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+	glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+	for (uint32_t v = mesh.vertex_begin; v < mesh.vertex_end; ++v) {
+		min = glm::min(min, vertices[v].Position);
+		max = glm::max(max, vertices[v].Position);
+	}
+	*min_ = min;
+	*max_ = max;
+}
+
+//float to half float, rounding to nearest even:
+static uint16_t pack_half(float f) {
+	uint32_t bits;
+	std::memcpy(&bits, &f, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t float_exponent = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+	if (float_exponent == 0xff) return uint16_t(sign | 0x7c00 | (mantissa ? 0x200 : 0)); //infinity or NaN
+
+	int32_t exponent = int32_t(float_exponent) - 127 + 15;
+	if (exponent >= 0x1f) return uint16_t(sign | 0x7c00); //too big, becomes infinity
+	if (exponent <= 0) {
+		//too small for a normal half float -- becomes subnormal (or zero):
+		if (exponent < -10) return uint16_t(sign);
+		mantissa |= 0x800000;
+		uint32_t shift = uint32_t(14 - exponent);
+		uint32_t half = mantissa >> shift;
+		uint32_t rest = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (half & 1))) half += 1;
+		return uint16_t(sign | half);
+	}
+	uint32_t half = (uint32_t(exponent) << 10) | (mantissa >> 13);
+	uint32_t rest = mantissa & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half += 1; //(a carry into the exponent is still correct)
+	return uint16_t(sign | half);
+}
+
+std::vector< MeshData::PackedVertex > MeshData::pack() const {
+	std::vector< PackedVertex > packed(vertices.size(), PackedVertex{glm::u16vec3(0), 0, 0, glm::u8vec4(0), glm::u16vec2(0)});
+	std::vector< bool > done(vertices.size(), false);
+
+	//snorm values in the low 10 bits:
+	auto pack_snorm10 = [](float f) {
+		return uint32_t(int32_t(std::round(std::max(-1.0f, std::min(1.0f, f)) * 511.0f))) & 0x3ff;
+	};
+
+	for (auto const &mesh : meshes) {
+		glm::vec3 min, max;
+		bounds(mesh, &min, &max);
+		glm::vec3 extent = max - min;
+		glm::vec3 scale = glm::vec3(
+			extent.x > 0.0f ? 65535.0f / extent.x : 0.0f,
+			extent.y > 0.0f ? 65535.0f / extent.y : 0.0f,
+			extent.z > 0.0f ? 65535.0f / extent.z : 0.0f
+		);
+
+		for (uint32_t v = mesh.vertex_begin; v < mesh.vertex_end; ++v) {
+			if (done[v]) {
+				throw std::runtime_error("Can't pack vertices: mesh '" + mesh.name + "' shares vertices with another mesh.");
+			}
+			done[v] = true;
+
+			Vertex const &in = vertices[v];
+			PackedVertex &out = packed[v];
+			glm::vec3 q = glm::round((in.Position - min) * scale);
+			out.Position = glm::u16vec3(
+				uint16_t(std::min(q.x, 65535.0f)),
+				uint16_t(std::min(q.y, 65535.0f)),
+				uint16_t(std::min(q.z, 65535.0f))
+			);
+			out.Normal = pack_snorm10(in.Normal.x) | (pack_snorm10(in.Normal.y) << 10) | (pack_snorm10(in.Normal.z) << 20);
+			out.Color = in.Color;
+			out.TexCoord = glm::u16vec2(pack_half(in.TexCoord.x), pack_half(in.TexCoord.y));
+		}
+	}
+
+	return packed;
+}
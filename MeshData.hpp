@@ -0,0 +1,122 @@
+#pragma once
+
+/*
+ * MeshData is the CPU-side contents of a '.pnct' mesh file, as read by
+ *  MeshBuffer and by offline mesh tools (see pnct-tool.cpp).
+ *
+ * '.pnct' files are a sequence of chunks (see read_write_chunk.hpp):
+ *  pnct - vertices (MeshData::Vertex)
+ *  str0 - characters of mesh names
+ *  idx0 - per-mesh { name_begin, name_end, vertex_begin, vertex_end } (non-indexed meshes)
+ *   ..or, for indexed meshes..
+ *  idx1 - per-mesh { name_begin, name_end, vertex_begin, vertex_end, index_begin, index_end }
+ *  ix16 or ix32 - indices (16-bit if every index fits, 32-bit otherwise)
+ *  bnd0 - (optional) per-mesh bounds (MeshData::Bounds), in the same order as the index chunk
+ * Files written by MeshData::write() also start with a table of contents ('toc0' -- see read_write_chunk.hpp).
+ * Readers look chunks up by magic number, so the order of chunks doesn't matter and unknown chunks are ignored.
+ *
+ * In indexed files, each mesh's indices only refer to vertices in its
+ *  [vertex_begin, vertex_end) range, and indices are relative to the start of the whole vertex array.
+ *
+ * Writers pad 'str0' to a multiple of 4 bytes so that the chunks after it are aligned (see ChunkFile.hpp).
+ *
+ */
+
+#include "ChunkFile.hpp"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct MeshData {
+	struct Vertex {
+		glm::vec3 Position;
+		glm::vec3 Normal;
+		glm::u8vec4 Color;
+		glm::vec2 TexCoord;
+	};
+	static_assert(sizeof(Vertex) == 3*4+3*4+4*1+2*4, "Vertex is packed.");
+
+	//compact version of Vertex (20 bytes instead of 36), as made by pack():
+	struct PackedVertex {
+		glm::u16vec3 Position; //unsigned normalized, from the mesh's bounds() min (0) to max (0xffff)
+		uint16_t padding_; //(keeps Normal aligned)
+		uint32_t Normal; //signed normalized 10:10:10:2 (i.e., GL_INT_2_10_10_10_REV); w is zero
+		glm::u8vec4 Color;
+		glm::u16vec2 TexCoord; //half floats
+	};
+	static_assert(sizeof(PackedVertex) == 3*2+2+4+4*1+2*2, "PackedVertex is packed.");
+
+	struct Bounds {
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(Bounds) == 6*4, "Bounds is packed.");
+
+	struct Mesh {
+		std::string name;
+		uint32_t vertex_begin = 0, vertex_end = 0; //vertices used by the mesh
+		uint32_t index_begin = 0, index_end = 0; //indices of the mesh's triangles (if indexed)
+	};
+
+	std::vector< Vertex > vertices;
+	bool indexed = false; //are meshes drawn using indices? (otherwise, they are drawn using vertices [vertex_begin,vertex_end) in order)
+	std::vector< uint32_t > indices;
+	std::vector< Mesh > meshes;
+
+	//read from / write to a '.pnct' file:
+	// note: throws on errors
+	void read(std::string const &filename);
+	void write(std::string const &filename) const;
+
+	//the contents of a '.pnct' file, viewed in place in a ChunkFile (only the mesh table is copied):
+	// (e.g., so MeshBuffer can upload vertices straight from the file)
+	struct View {
+		ChunkFile::Span< Vertex > vertices;
+		bool indexed = false;
+		uint32_t index_size = 0; //bytes per index: 2 ('ix16') or 4 ('ix32'); 0 if not indexed
+		ChunkFile::Span< uint8_t > index_data; //indices as stored in the file (not necessarily aligned)
+		std::vector< Mesh > meshes;
+		ChunkFile::Span< Bounds > bounds; //per-mesh bounds from the 'bnd0' chunk (empty if the file doesn't have one)
+		std::vector< Bounds > bounds_fallback; //(holds bounds if they weren't aligned in the file)
+
+		size_t index_count() const { return index_size ? index_data.size() / index_size : 0; }
+		uint32_t index(size_t i) const;
+
+		View() = default;
+		View(View &&) = default; //(moving keeps 'bounds' pointing at 'bounds_fallback', copying wouldn't)
+		View(View const &) = delete;
+	};
+	// note: throws on errors (and checks everything read() does, except checksums; no vertex data is read)
+	static View view(ChunkFile const &file);
+
+	//merge identical vertices within each mesh, making indexed meshes (if they weren't already):
+	// (vertices are kept in order of first use)
+	void weld();
+
+	//bounding box of a mesh's vertices:
+	void bounds(Mesh const &mesh, glm::vec3 *min, glm::vec3 *max) const;
+
+	//vertices in PackedVertex format, with positions quantized to each mesh's bounds:
+	// (position = min + (max - min) * Position / 0xffff)
+	// note: throws if meshes share vertices, since they couldn't be quantized to both meshes' bounds
+	std::vector< PackedVertex > pack() const;
+
+	//reorder each mesh's triangles and vertices so they draw faster (welds first, if meshes aren't indexed):
+	// - triangles are ordered to reuse recently transformed vertices (Forsyth, "Linear-Speed Vertex Cache Optimisation"),
+	// - runs of triangles are then ordered outward-facing-first to reduce overdraw (as in Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"),
+	// - and vertices are ordered by first use, so they are fetched in order.
+	// (implemented in MeshData-optimize.cpp)
+	void optimize();
+
+	//how well the meshes' triangle order uses a (simulated, FIFO) post-transform vertex cache:
+	struct CacheStats {
+		uint32_t triangles = 0;
+		uint32_t vertices = 0; //(distinct vertices used by triangles)
+		uint32_t transforms = 0; //vertices transformed (i.e., cache misses)
+		float acmr() const { return triangles ? float(transforms) / float(triangles) : 0.0f; } //average cache miss ratio (3 is worst; ~0.5-0.7 is great)
+		float atvr() const { return vertices ? float(transforms) / float(vertices) : 0.0f; } //average transformed vertex ratio (1 is ideal)
+	};
+	CacheStats cache_stats(uint32_t cache_size = 16) const;
+};
@@ -15,11 +15,20 @@ struct Mode : std::enable_shared_from_this< Mode > {
 
 	//update is called at the start of a new frame, after events are handled:
 	// 'elapsed' is time in seconds since the last call to 'update'
+	// (with a fixed timestep -- see 'tick' below -- update is called zero or more times per frame, always with elapsed == tick)
 	virtual void update(float elapsed) { }
 
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
+	//fixed timestep (optional):
+	// if 'tick' is set, the main loop calls update(tick) as many times as it takes to keep up with real time,
+	// and, before draw, sets 'alpha' to how far real time has gotten from the last update toward the next one (in [0,1)).
+	// Modes can use 'alpha' to draw part-way between their previous and current state (e.g., with Scene::Interpolator).
+	float tick = 0.0f; //seconds per update (0 == update once per frame with that frame's elapsed time)
+	float alpha = 1.0f; //(set by main loop)
+	float tick_accumulator = 0.0f; //(used by main loop) real time not yet simulated
+
 	//Mode::current is the Mode to which events are dispatched.
 	// use 'set_current' to change the current Mode (e.g., to switch to a menu)
 	static std::shared_ptr< Mode > current;
@@ -4,6 +4,7 @@
 #include "PathFont.hpp"
 
 #include <iostream>
+#include <map>
 
 PathFont::PathFont(uint32_t glyphs_,
 	const float *glyph_widths_,
@@ -21,4 +22,66 @@ PathFont::PathFont(uint32_t glyphs_,
 			std::cerr << "WARNING: ignoring duplicate glyph for '" << str << "'." << std::endl;
 		}
 	}
+
+	{ //build trie for match_glyph:
+		//make nodes (with children in maps for now):
+		std::vector< std::map< uint8_t, uint32_t > > children(1);
+		trie_nodes.resize(1);
+		for (auto const &[str, glyph] : glyph_map) {
+			uint32_t node = 0;
+			for (char c : str) {
+				auto f = children[node].find(uint8_t(c));
+				if (f == children[node].end()) {
+					f = children[node].emplace(uint8_t(c), uint32_t(trie_nodes.size())).first;
+					trie_nodes.emplace_back();
+					children.emplace_back();
+				}
+				node = f->second;
+			}
+			trie_nodes[node].glyph = glyph;
+		}
+
+		//pack children into edge arrays:
+		for (uint32_t n = 0; n < trie_nodes.size(); ++n) {
+			trie_nodes[n].first_edge = uint32_t(trie_edge_bytes.size());
+			trie_nodes[n].edge_count = uint32_t(children[n].size());
+			for (auto const &[byte, child] : children[n]) {
+				trie_edge_bytes.emplace_back(byte);
+				trie_edge_nodes.emplace_back(child);
+			}
+		}
+
+		trie_root_children.fill(0);
+		for (auto const &[byte, child] : children[0]) {
+			trie_root_children[byte] = child;
+		}
+	}
+}
+
+uint32_t PathFont::match_glyph(char const *begin, char const *end, uint32_t *length) const {
+	uint32_t glyph = -1U;
+	*length = 0;
+	uint32_t node = 0;
+	for (char const *c = begin; c != end; ++c) {
+		uint8_t byte = uint8_t(*c);
+		uint32_t next = 0;
+		if (node == 0) {
+			next = trie_root_children[byte];
+		} else {
+			TrieNode const &n = trie_nodes[node];
+			for (uint32_t e = n.first_edge; e < n.first_edge + n.edge_count; ++e) {
+				if (trie_edge_bytes[e] == byte) {
+					next = trie_edge_nodes[e];
+					break;
+				}
+			}
+		}
+		if (next == 0) break;
+		node = next;
+		if (trie_nodes[node].glyph != -1U) {
+			glyph = trie_nodes[node].glyph;
+			*length = uint32_t(c - begin + 1);
+		}
+	}
+	return glyph;
 }
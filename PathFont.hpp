@@ -10,6 +10,7 @@
 
 #include <glm/glm.hpp>
 
+#include <array>
 #include <string>
 #include <vector>
 #include <map>
@@ -33,6 +34,23 @@ struct PathFont {
 	//computed in constructor:
 	std::map< std::string, uint32_t > glyph_map;
 
+	//find the longest glyph whose characters start [begin,end):
+	// returns the glyph (or -1U if no glyph matches) and sets *length to the number of bytes it covers
+	// (uses a trie built in the constructor, so it doesn't allocate or compare strings)
+	uint32_t match_glyph(char const *begin, char const *end, uint32_t *length) const;
+
+	//internals:
+	//trie over the (UTF-8) bytes of glyph characters; node 0 is the root:
+	struct TrieNode {
+		uint32_t glyph = -1U; //glyph whose characters end at this node (or -1U)
+		uint32_t first_edge = 0; //children are trie_edge_*[first_edge, first_edge + edge_count), sorted by byte
+		uint32_t edge_count = 0;
+	};
+	std::vector< TrieNode > trie_nodes;
+	std::vector< uint8_t > trie_edge_bytes;
+	std::vector< uint32_t > trie_edge_nodes;
+	std::array< uint32_t, 256 > trie_root_children; //root's child for each byte, or 0 if none (direct lookup, since most text is single bytes)
+
 	//the default font:
 	static PathFont font;
 };
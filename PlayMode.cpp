@@ -13,13 +13,17 @@
 #include <random>
 
 GLuint duck_meshes_for_lit_color_texture_program = 0;
-Load< MeshBuffer > duck_meshes(LoadTagDefault, []() -> MeshBuffer const * {
-	MeshBuffer const *ret = new MeshBuffer(data_path("duck.pnct"));
-	duck_meshes_for_lit_color_texture_program = ret->make_vao_for_program(lit_color_texture_program->program);
-	return ret;
+GLuint duck_meshes_for_lit_color_texture_program_instanced = 0;
+Load< MeshBuffer > duck_meshes(LoadTagDefault, []() -> MeshBuffer * {
+	return new MeshBuffer(data_path("duck.pnct"), MeshBuffer::DeferUpload, MeshBuffer::Optimize | MeshBuffer::Quantize); //(processed on the loading thread)
+}, [](MeshBuffer &buffer) {
+	buffer.upload();
+	duck_meshes_for_lit_color_texture_program = buffer.make_vao_for_program(lit_color_texture_program->program);
+	//(so that the many turtles can be drawn with instancing)
+	duck_meshes_for_lit_color_texture_program_instanced = buffer.make_vao_for_program(lit_color_texture_program_instanced->program, Scene::make_instance_vao(lit_color_texture_program_instanced->program));
 });
 
-Load< Scene > duck_scene(LoadTagDefault, []() -> Scene const * {
+Load< Scene > duck_scene(LoadTagDefault, []() -> Scene * {
 	return new Scene(data_path("duck.scene"), [&](Scene &scene, Scene::Transform *transform, std::string const &mesh_name){
 		Mesh const &mesh = duck_meshes->lookup(mesh_name);
 
@@ -29,23 +33,44 @@ Load< Scene > duck_scene(LoadTagDefault, []() -> Scene const * {
 		drawable.pipeline = lit_color_texture_program_pipeline;
 
 		drawable.pipeline.vao = duck_meshes_for_lit_color_texture_program;
+		drawable.pipeline.instanced.vao = duck_meshes_for_lit_color_texture_program_instanced;
 		drawable.pipeline.type = mesh.type;
 		drawable.pipeline.start = mesh.start;
 		drawable.pipeline.count = mesh.count;
+		drawable.pipeline.index_type = mesh.index_type;
+		drawable.pipeline.min = mesh.min;
+		drawable.pipeline.max = mesh.max;
+		drawable.pipeline.position_scale = mesh.position_scale;
+		drawable.pipeline.position_offset = mesh.position_offset;
 
 	});
-});
+}, nullptr, { &duck_meshes });
+
+Load< std::vector< Sound::Sample > > assassin_scan_samples(LoadTagDefault, []() -> std::vector< Sound::Sample > * {
+	auto ret = new std::vector< Sound::Sample >();
+	ret->reserve(PlayMode::NUM_ASSASSIN_SCAN_SOUNDS);
+	for (uint16_t i = 0; i < PlayMode::NUM_ASSASSIN_SCAN_SOUNDS; i++) {
+		ret->emplace_back(data_path("s" + std::to_string(i) + ".wav"));
+	}
+	return ret;
+}, nullptr);
+
+Load< Sound::Sample > kill_sample(LoadTagDefault, []() -> Sound::Sample * {
+	return new Sound::Sample(data_path("kill.wav"));
+}, nullptr);
 
 std::default_random_engine gen;
 std::uniform_real_distribution<float> distribution(0, 1);
 
-PlayMode::PlayMode() : scene(*duck_scene) {
+PlayMode::PlayMode(uint32_t turtle_count) : scene(*duck_scene) {
+	Scene::Transform *reference_turtle = nullptr;
 	for (auto& transform : scene.transforms) {
 		if (transform.name == "Duck") {
 			duck = &transform;
 		} else if (transform.name.substr(0, 6) == "Turtle") {
-			turtles[num_turtles++] = &transform;
+			turtles.emplace_back(&transform);
 			if (transform.name == "Turtle") { // Original reference turtle
+				reference_turtle = &transform;
 				turtle_z = transform.position.z;
 				turtle_initial_rotation = transform.rotation;
 			}
@@ -55,13 +80,53 @@ PlayMode::PlayMode() : scene(*duck_scene) {
 		throw std::runtime_error("Duck not found.");
 	}
 
+	// add copies of the reference turtle if more turtles were asked for than the scene has
+	if (turtle_count > turtles.size()) {
+		Scene::Drawable const *reference_drawable = nullptr;
+		for (auto const &drawable : scene.drawables) {
+			if (reference_turtle && drawable.transform == reference_turtle) reference_drawable = &drawable;
+		}
+		if (reference_drawable == nullptr) {
+			throw std::runtime_error("Turtle not found.");
+		}
+		while (turtles.size() < turtle_count) {
+			scene.transforms.emplace_back();
+			Scene::Transform *turtle = &scene.transforms.back();
+			turtle->name = "Turtle." + std::to_string(turtles.size());
+			turtle->position = reference_turtle->position;
+			turtle->rotation = reference_turtle->rotation;
+			turtle->scale = reference_turtle->scale;
+			turtle->parent = reference_turtle->parent;
+			scene.drawables.emplace_back(*reference_drawable);
+			scene.drawables.back().transform = turtle;
+			turtles.emplace_back(turtle);
+		}
+	}
+	turtle_sim.resize(uint32_t(turtles.size()));
+
 	duck_initial_position = duck->position;
 	duck_initial_rotation = duck->rotation;
 
+	//remember how the level started, for restarting:
+	initial_state = scene.snapshot();
+
 	duck_size = 1.f;
-	// spawn turtles
+	spawn_turtles();
+	for (uint16_t i = 0; i < NUM_ASSASSIN_SCAN_SOUNDS; i++) {
+		assassin_scan_sounds[i] = &(*assassin_scan_samples)[i];
+	}
+	kill_sound = kill_sample;
+
+	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
+	camera = &scene.cameras.front();
+}
+
+PlayMode::~PlayMode() {
+}
+
+void PlayMode::spawn_turtles() {
 	static float pi = acosf(-1.f);
-	for (uint16_t i = 0; i < num_turtles; i++) {
+	for (uint32_t i = 0; i < turtles.size(); i++) {
 		static float radius = 50.f;
 		float tx, ty;
 		while(true) {
@@ -69,25 +134,16 @@ PlayMode::PlayMode() : scene(*duck_scene) {
 			ty = -1 + 2*distribution(gen);
 			float dist = tx*tx + ty*ty;
 			if (dist > 1 || dist < 0.25) continue;
-			turtles[i]->position.x = tx * radius;
-			turtles[i]->position.y = ty * radius;
-			turtles[i]->position.z = turtle_z;
+			turtle_sim.x[i] = tx * radius;
+			turtle_sim.y[i] = ty * radius;
+			turtles[i]->position = glm::vec3(turtle_sim.x[i], turtle_sim.y[i], turtle_z);
 			break;
 		}
-		turtle_angles[i] = distribution(gen) * 2 * pi;
-		turtle_turn_dirs[i] = 0;
-		turtle_dead[i] = false;
+		turtle_sim.angle[i] = (distribution(gen) * 2 - 1) * pi;
+		turtle_sim.turn_dir[i] = 0;
+		turtle_sim.dead[i] = false;
 	}
-	for (uint16_t i = 0; i < NUM_ASSASSIN_SCAN_SOUNDS; i++) {
-		assassin_scan_sounds[i] = new Sound::Sample(data_path("s" + std::to_string(i) + ".wav"));
-	}
-	kill_sound = new Sound::Sample(data_path("kill.wav"));
-
-	if (scene.cameras.size() != 1) throw std::runtime_error("Expecting scene to have exactly one camera, but it has " + std::to_string(scene.cameras.size()));
-	camera = &scene.cameras.front();
-}
-
-PlayMode::~PlayMode() {
+	num_turtles_left = int(turtles.size()) - NUM_ASSASSINS;
 }
 
 bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
@@ -96,6 +152,10 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 		SDL_SetRelativeMouseMode(SDL_FALSE);
 		return true;
 	}
+	if (is_down && evt.key.keysym.sym == SDLK_F3) {
+		stats_overlay.visible = !stats_overlay.visible;
+		return true;
+	}
 	if (evt.key.keysym.sym == SDLK_LEFT) {
 		left.pressed = is_down;
 		return true;
@@ -126,33 +186,22 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 }
 
 void PlayMode::update(float elapsed) {
+	//(with a fixed timestep, remember where things were so draw() can blend from there)
+	if (tick > 0.0f) interpolator.save_previous(scene);
+
 	if (game_over) {
 		if (r.pressed) {
 			game_over = 0;
 
-			// Reset duck position
-			duck->position = duck_initial_position;
+			// Reset duck (and everything else) to how the level started
+			scene.restore(initial_state);
 			duck_size = 1.f;
 
 			// Reset turtles
-			static float pi = acosf(-1.f);
-			for (uint16_t i = 0; i < num_turtles; i++) {
-				static float radius = 50.f;
-				float tx, ty;
-				while(true) {
-					tx = -1 + 2*distribution(gen);
-					ty = -1 + 2*distribution(gen);
-					float dist = tx*tx + ty*ty;
-					if (dist > 1 || dist < 0.25) continue;
-					turtles[i]->position.x = tx * radius;
-					turtles[i]->position.y = ty * radius;
-					turtles[i]->position.z = turtle_z;
-					break;
-				}
-				turtle_angles[i] = distribution(gen) * 2 * pi;
-				turtle_turn_dirs[i] = 0;
-				turtle_dead[i] = false;
-			}
+			spawn_turtles();
+
+			//(don't blend from where things were before the reset)
+			if (tick > 0.0f) interpolator.save_previous(scene);
 		}
 		return;
 	}
@@ -197,45 +246,50 @@ void PlayMode::update(float elapsed) {
 	 	// randomly change during direction of some turtles
 		if (time_since_update > 0.2f) {
 			time_since_update = 0;
-			for (uint16_t i = 0; i < num_turtles; i++) {
+			for (uint32_t i = 0; i < turtles.size(); i++) {
 				if (distribution(gen) < 0.2f) { // only some turtles change direction
 					float rng = distribution(gen);
 					if (rng < 1.f/3.f) {
-						turtle_turn_dirs[i] = -1;
+						turtle_sim.turn_dir[i] = -1;
 					} else if (rng < 2.f / 3.f) {
-						turtle_turn_dirs[i] = 0;
+						turtle_sim.turn_dir[i] = 0;
 					} else {
-						turtle_turn_dirs[i] = 1;
+						turtle_sim.turn_dir[i] = 1;
 					}
 				}
 			}
 		}
-		// update turtles by moving then turning
+		// update turtles by moving, turning, and clipping into pond
 		static float speed = 5.f;
 		static float turn_speed = 1.5f;
-		static float pi = acosf(-1.f);
-		for (uint16_t i = 0; i < num_turtles; i++) {
-			turtles[i]->position.x += speed * elapsed * cosf(turtle_angles[i]);
-			turtles[i]->position.y += speed * elapsed * sinf(turtle_angles[i]);
-			turtle_angles[i] += turtle_turn_dirs[i] * elapsed * turn_speed;
-			if (turtle_angles[i] < 0) turtle_angles[i] += 2 * pi;
-			if (turtle_angles[i] > 0) turtle_angles[i] -= 2 * pi;
+		static float pond_radius = 50.f;
+		step_turtles(turtle_sim, elapsed, speed, turn_speed, pond_radius);
+
+		// copy to turtle transforms
+		// (the rotation is turtle_initial_rotation * angleAxis(angle, z), written out using angleAxis == (cos(angle/2), 0, 0, sin(angle/2)))
+		glm::quat const &q = turtle_initial_rotation;
+		for (uint32_t i = 0; i < turtles.size(); i++) {
+			float c = turtle_sim.half_cos[i];
+			float s = turtle_sim.half_sin[i];
+			turtles[i]->position.x = turtle_sim.x[i];
+			turtles[i]->position.y = turtle_sim.y[i];
+			turtles[i]->rotation = glm::quat(q.w * c - q.z * s, q.x * c + q.y * s, q.y * c - q.x * s, q.z * c + q.w * s);
 		}
-		// clip turtles into pond
-		for (uint16_t i = 0; i < num_turtles; i++) {
-			static float pond_radius = 50.f;
-			float dist = glm::distance(turtles[i]->position, glm::vec3(0.f, 0.f, turtle_z));
-			if (dist > pond_radius) {
-				glm::vec3 diff = turtles[i]->position - glm::vec3(0.f, 0.f, turtle_z);
-				float angle = atan2f(diff.y, diff.x);
-				turtles[i]->position.x = pond_radius * cosf(angle);
-				turtles[i]->position.y = pond_radius * sinf(angle);
-				turtle_angles[i] += pi;
-			}
+	}
+
+	{ // bucket turtles by position, so only turtles near the duck need to be checked below
+		// (turtles move slowly, so buckets are only rebuilt once a turtle gets turtle_hash_slack away from where it was bucketed)
+		bool rebuild = (turtle_positions.size() != turtles.size());
+		for (uint32_t i = 0; i < turtles.size() && !rebuild; i++) {
+			glm::vec2 moved = glm::vec2(turtle_sim.x[i], turtle_sim.y[i]) - turtle_positions[i];
+			if (glm::dot(moved, moved) > turtle_hash_slack * turtle_hash_slack) rebuild = true;
 		}
-		// rotate turtles
-		for (uint16_t i = 0; i < num_turtles; i++) {
-			turtles[i]->rotation = turtle_initial_rotation * glm::angleAxis(turtle_angles[i], glm::vec3(0.f, 0.f, 1.f));
+		if (rebuild) {
+			turtle_positions.resize(turtles.size());
+			for (uint32_t i = 0; i < turtles.size(); i++) {
+				turtle_positions[i] = glm::vec2(turtle_sim.x[i], turtle_sim.y[i]);
+			}
+			turtle_hash.build(turtle_positions.data(), uint32_t(turtle_positions.size()));
 		}
 	}
 
@@ -243,6 +297,7 @@ void PlayMode::update(float elapsed) {
 		if (z.pressed) {
 			if (!played_assassin_scan_sound) {
 				// find distance of closest assassin turtle
+				// (there are only NUM_ASSASSINS of these, so checking them all is cheaper than a turtle_hash query)
 				float closest = 100.f;
 				for (uint16_t i = 0; i < NUM_ASSASSINS; i++) {
 					closest = std::min(closest, glm::distance(turtles[i]->position, duck->position) - duck_size);
@@ -262,39 +317,31 @@ void PlayMode::update(float elapsed) {
 		}
 	}
 
-	{ // eat normal turtles
-		for (uint16_t i = NUM_ASSASSINS; i < num_turtles; i++) {
+	{ // eat normal turtles (and move them out of screen)
+		turtle_hash.query(glm::vec2(duck->position), turtle_size + duck_size + turtle_hash_slack, [&](uint32_t i) {
+			if (i < NUM_ASSASSINS || turtle_sim.dead[i]) return;
 			float dist = glm::distance(turtles[i]->position, duck->position);
 			if (dist < turtle_size + duck_size) {
-				turtle_dead[i] = true;
+				turtle_sim.dead[i] = true;
 				duck_size *= 1.07f;
 				Sound::play(*kill_sound);
-			}
-		}
-	}
-
-	{ // move dead turtles out of screen
-		for (uint16_t i = NUM_ASSASSINS; i < num_turtles; i++) {
-			if (turtle_dead[i]) {
 				turtles[i]->position.z = -10;
+				num_turtles_left--;
 			}
-		}
+		});
 	}
 
 	{ // touch assassin = death
-		for (uint16_t i = 0; i < NUM_ASSASSINS; i++) {
+		turtle_hash.query(glm::vec2(duck->position), turtle_size + duck_size + turtle_hash_slack, [&](uint32_t i) {
+			if (i >= NUM_ASSASSINS) return;
 			float dist = glm::distance(turtles[i]->position, duck->position);
 			if (dist < turtle_size + duck_size) {
 				game_over = 1;
 			}
-		}
+		});
 	}
 
 	{ // All turtles dead = win
-		num_turtles_left = 0;
-		for (uint16_t i = NUM_ASSASSINS; i < num_turtles; i++) {
-			if (!turtle_dead[i]) num_turtles_left++;
-		}
 		if (num_turtles_left == 0) game_over = 2;
 	}
 
@@ -304,12 +351,14 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	//update camera aspect ratio for drawable:
 	camera->aspect = float(drawable_size.x) / float(drawable_size.y);
 
-	//set up light type and position for lit_color_texture_program:
+	//set up light type and position for lit_color_texture_program (and its instanced version):
 	// TODO: consider using the Light(s) in the scene to do this
-	glUseProgram(lit_color_texture_program->program);
-	glUniform1i(lit_color_texture_program->LIGHT_TYPE_int, 1);
-	glUniform3fv(lit_color_texture_program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
-	glUniform3fv(lit_color_texture_program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	for (LitColorTextureProgram const *program : { &*lit_color_texture_program, &*lit_color_texture_program_instanced }) {
+		glUseProgram(program->program);
+		glUniform1i(program->LIGHT_TYPE_int, 1);
+		glUniform3fv(program->LIGHT_DIRECTION_vec3, 1, glm::value_ptr(glm::vec3(0.0f, 0.0f,-1.0f)));
+		glUniform3fv(program->LIGHT_ENERGY_vec3, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 0.95f)));
+	}
 	glUseProgram(0);
 
 	glClearColor(0.5f, 0.5f, 0.5f, 1.0f);
@@ -321,10 +370,16 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
 	GL_ERRORS(); //print any errors produced by this setup code
 
+	//with a fixed timestep, draw the scene part-way between the last two updates:
+	if (tick > 0.0f) interpolator.begin(scene, alpha);
 	scene.draw(*camera);
+	if (tick > 0.0f) interpolator.end(scene);
+
+	//(text and overlay lines are uploaded and drawn together when 'batch' goes out of scope, with depth test off)
+	glDisable(GL_DEPTH_TEST);
+	DrawLines::Batch batch;
 
 	auto draw_text = [&](std::string text) {
-		glDisable(GL_DEPTH_TEST);
 		float aspect = float(drawable_size.x) / float(drawable_size.y);
 		DrawLines lines(glm::mat4(
 			1.0f / aspect, 0.0f, 0.0f, 0.0f,
@@ -337,12 +392,12 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 		lines.draw_text(text,
 			glm::vec3(-aspect + 0.2 * H, -0.5f + 0.1f * H, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
-			glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+			glm::u8vec4(0x00, 0x00, 0x00, 0x00), nullptr, &text_cache);
 		float ofs = 2.0f / drawable_size.y;
 		lines.draw_text(text,
 			glm::vec3(-aspect + 0.2 * H + ofs, -0.5f + 0.1f * H + ofs, 0.0),
 			glm::vec3(H, 0.0f, 0.0f), glm::vec3(0.0f, H, 0.0f),
-			glm::u8vec4(0xff, 0xff, 0xff, 0x00));
+			glm::u8vec4(0xff, 0xff, 0xff, 0x00), nullptr, &text_cache);
 	};
 
 	if (game_over == 0) {
@@ -352,4 +407,6 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	} else if (game_over == 2) {
 		draw_text("You captured all the turtles! Press R to restart.");
 	}
+
+	stats_overlay.draw(drawable_size, scene.draw_stats);
 }
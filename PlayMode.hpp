@@ -1,7 +1,11 @@
 #include "Mode.hpp"
 
 #include "Scene.hpp"
+#include "DrawLines.hpp"
 #include "Sound.hpp"
+#include "SpatialHash.hpp"
+#include "StatsOverlay.hpp"
+#include "step_turtles.hpp"
 
 #include <glm/glm.hpp>
 
@@ -9,7 +13,9 @@
 #include <deque>
 
 struct PlayMode : Mode {
-	PlayMode();
+	//turtle_count is the number of turtles to play with (0 == just those in the scene):
+	// (turtles beyond those in the scene are copies of the scene's "Turtle")
+	PlayMode(uint32_t turtle_count = 0);
 	virtual ~PlayMode();
 
 	//functions called by main loop:
@@ -26,6 +32,8 @@ struct PlayMode : Mode {
 
 	//local copy of the game scene (so code can change it during gameplay):
 	Scene scene;
+	Scene::Snapshot initial_state; //(restored when restarting)
+	Scene::Interpolator interpolator; //(used when running with a fixed timestep)
 
 	// Duck transforms
 	Scene::Transform* duck = nullptr;
@@ -34,25 +42,28 @@ struct PlayMode : Mode {
 	glm::quat duck_initial_rotation;
 
 	// Turtle stuff
-	static constexpr uint16_t MAX_TURTLES = 100;
 	static constexpr float turtle_size = 1;
-	uint16_t num_turtles = 0;
 	float turtle_z;
 	glm::quat turtle_initial_rotation;
-	Scene::Transform* turtles[MAX_TURTLES];
+	std::vector< Scene::Transform* > turtles; // the first NUM_ASSASSINS are assassins
 	float time_since_update = 0;
-	float turtle_angles[MAX_TURTLES];
-	int turtle_turn_dirs[MAX_TURTLES]; // -1 for left, 0 for still, 1 for right
-	bool turtle_dead[MAX_TURTLES];
+	TurtleArrays turtle_sim; // simulation state (position, angle, turn_dir, dead), indexed like 'turtles'
 	int num_turtles_left;
-	Sound::Sample* kill_sound;
+	Sound::Sample const *kill_sound;
+	void spawn_turtles(); // scatter turtles around the pond
+
+	// Turtle positions in the pond's xy plane, bucketed for finding turtles near the duck
+	// (turtle_positions are where turtles were when bucketed; queries are widened by turtle_hash_slack to allow for movement since)
+	std::vector< glm::vec2 > turtle_positions;
+	SpatialHash turtle_hash = SpatialHash(4.0f);
+	static constexpr float turtle_hash_slack = 1.0f;
 
 	// Assassins
 	static constexpr uint16_t NUM_ASSASSINS = 10;
 	static constexpr uint16_t NUM_ASSASSIN_SCAN_SOUNDS = 7;
 	static constexpr float dist_thresholds[NUM_ASSASSIN_SCAN_SOUNDS - 1] = {5, 8, 13, 20, 25, 30};
 	bool played_assassin_scan_sound = false;
-	Sound::Sample* assassin_scan_sounds[NUM_ASSASSIN_SCAN_SOUNDS];
+	Sound::Sample const *assassin_scan_sounds[NUM_ASSASSIN_SCAN_SOUNDS];
 	
 	// Game over flag
 	int game_over = 0;
@@ -60,4 +71,10 @@ struct PlayMode : Mode {
 	//camera:
 	Scene::Camera *camera = nullptr;
 
+	//lines of the status text (which is usually the same from frame to frame):
+	DrawLines::TextCache text_cache;
+
+	//performance statistics display (toggled with F3):
+	StatsOverlay stats_overlay;
+
 };
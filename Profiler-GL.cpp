@@ -0,0 +1,62 @@
+//GPU zones for Profiler (kept apart from Profiler.cpp so that code without OpenGL can still use CPU zones):
+
+#include "Profiler.hpp"
+
+#include "GL.hpp"
+
+#include <array>
+#include <cassert>
+
+namespace {
+	//GL_TIME_ELAPSED queries waiting for results, as a ring buffer:
+	// (results usually take a frame or two to arrive, so several frames' worth may be in flight)
+	struct Query {
+		GLuint query = 0; //(made on first use)
+		char const *name = nullptr;
+		uint64_t begin = 0; //CPU time when the zone started
+	};
+	std::array< Query, 64 > queries;
+	uint32_t first_query = 0; //oldest query in flight
+	uint32_t queries_in_flight = 0;
+	bool zone_open = false;
+}
+
+Profiler::GPUZone::GPUZone(char const *name) : active(false) {
+	if (!enabled()) return;
+	assert(!zone_open && "GPU zones can't nest.");
+	if (queries_in_flight == queries.size()) return; //(drop zone rather than wait for results)
+
+	Query &q = queries[(first_query + queries_in_flight) % queries.size()];
+	if (q.query == 0) glGenQueries(1, &q.query);
+	q.name = name;
+	q.begin = now();
+	glBeginQuery(GL_TIME_ELAPSED, q.query);
+	queries_in_flight += 1;
+
+	active = true;
+	zone_open = true;
+}
+
+Profiler::GPUZone::~GPUZone() {
+	if (!active) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	zone_open = false;
+}
+
+void Profiler::collect_gpu() {
+	assert(!zone_open && "GPU results should be collected outside GPU zones.");
+	//queries finish in the order they were issued, so stop at the first unfinished one:
+	while (queries_in_flight > 0) {
+		Query &q = queries[first_query];
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(q.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) break;
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(q.query, GL_QUERY_RESULT, &elapsed);
+		//(GPU zones are shown starting when their commands were issued, which is only approximately when they ran)
+		record_gpu(q.name, q.begin, q.begin + uint64_t(elapsed));
+
+		first_query = (first_query + 1) % queries.size();
+		queries_in_flight -= 1;
+	}
+}
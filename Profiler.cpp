@@ -0,0 +1,235 @@
+#include "Profiler.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+std::atomic< bool > Profiler::enabled_flag(false);
+
+namespace {
+	struct Event {
+		char const *name;
+		uint64_t begin, end;
+	};
+}
+
+//A track is a ring buffer of events shown as one row in a trace.
+// Only one thread writes events to a track, and it never waits for anything:
+// write_trace() copies events out by sequence number instead, and skips any that
+// might have been overwritten while it was copying them.
+struct Profiler::Track {
+	Track(uint32_t id_, std::string const &name_) : id(id_), name(name_) { }
+	uint32_t id;
+
+	std::mutex name_mutex; //(protects 'name', which isn't touched while recording)
+	std::string name;
+
+	//ring buffer slots (atomic so reading while a slot is written is well-defined; relaxed loads and stores are plain moves):
+	struct Slot {
+		std::atomic< char const * > name;
+		std::atomic< uint64_t > begin, end;
+	};
+	std::unique_ptr< Slot[] > storage; //(only touched by the writing thread)
+	std::atomic< Slot * > slots{nullptr}; //storage.get() once allocated
+
+	std::atomic< uint64_t > begun{0}; //events whose slot has started to be written
+	std::atomic< uint64_t > recorded{0}; //events whose slot is finished; the next goes in slots[recorded % ThreadCapacity]
+	std::atomic< uint64_t > cleared{0}; //events before this were cleared (and aren't written to traces)
+
+	void allocate() {
+		storage.reset(new Slot[Profiler::ThreadCapacity]);
+		slots.store(storage.get(), std::memory_order_release);
+	}
+
+	void add(Event const &event) {
+		Slot *s = slots.load(std::memory_order_relaxed);
+		if (!s) {
+			allocate();
+			s = storage.get();
+		}
+		uint64_t index = recorded.load(std::memory_order_relaxed);
+		begun.store(index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release); //(readers that see any of this slot's new data also see 'begun')
+		Slot &slot = s[index % Profiler::ThreadCapacity];
+		slot.name.store(event.name, std::memory_order_relaxed);
+		slot.begin.store(event.begin, std::memory_order_relaxed);
+		slot.end.store(event.end, std::memory_order_relaxed);
+		recorded.store(index + 1, std::memory_order_release);
+	}
+
+	//copy out (oldest to newest) the events that aren't cleared and weren't overwritten during the copy:
+	void copy_events(std::vector< Event > *events_) {
+		assert(events_);
+		auto &events = *events_;
+		events.clear();
+		Slot const *s = slots.load(std::memory_order_acquire);
+		if (!s) return;
+		uint64_t end = recorded.load(std::memory_order_acquire);
+		uint64_t begin = std::max(end - std::min< uint64_t >(end, Profiler::ThreadCapacity), cleared.load(std::memory_order_relaxed));
+		if (begin >= end) return;
+		events.reserve(size_t(end - begin));
+		for (uint64_t i = begin; i < end; ++i) {
+			Slot const &slot = s[i % Profiler::ThreadCapacity];
+			events.emplace_back(Event{
+				slot.name.load(std::memory_order_relaxed),
+				slot.begin.load(std::memory_order_relaxed),
+				slot.end.load(std::memory_order_relaxed)
+			});
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		//slots of events before this may have been (or be being) overwritten while copying:
+		uint64_t valid = begun.load(std::memory_order_relaxed);
+		valid = (valid > Profiler::ThreadCapacity ? valid - Profiler::ThreadCapacity : 0);
+		if (valid > begin) {
+			events.erase(events.begin(), events.begin() + size_t(std::min(valid, end) - begin));
+		}
+	}
+};
+
+namespace {
+	using Track = Profiler::Track;
+
+	//all tracks ever made (tracks outlive their threads, so zones from finished threads still get written):
+	struct Tracks {
+		std::mutex mutex;
+		std::vector< std::shared_ptr< Track > > list;
+		std::shared_ptr< Track > add(std::string const &name) {
+			std::unique_lock< std::mutex > lock(mutex);
+			list.emplace_back(std::make_shared< Track >(uint32_t(list.size()), name));
+			return list.back();
+		}
+		std::vector< std::shared_ptr< Track > > copy() {
+			std::unique_lock< std::mutex > lock(mutex);
+			return list;
+		}
+	};
+	Tracks &get_tracks() {
+		static Tracks tracks;
+		return tracks;
+	}
+
+	Track &gpu_track() {
+		static std::shared_ptr< Track > track = get_tracks().add("GPU");
+		return *track;
+	}
+
+	//(a plain pointer, so checking it doesn't need thread_local construction; tracks are never freed)
+	thread_local Track *current_track = nullptr;
+
+	Track &this_thread_track() {
+		if (!current_track) {
+			gpu_track(); //(make sure the GPU track is made first, so it shows up first)
+			current_track = get_tracks().add("").get();
+		}
+		return *current_track;
+	}
+
+	//write a string as a JSON string:
+	void write_json_string(std::ostream &out, std::string const &str) {
+		out << '"';
+		for (char c : str) {
+			if (c == '"' || c == '\\') out << '\\' << c;
+			else if (uint8_t(c) < 0x20) out << ' ';
+			else out << c;
+		}
+		out << '"';
+	}
+}
+
+void Profiler::set_enabled(bool enabled) {
+	enabled_flag.store(enabled, std::memory_order_relaxed);
+}
+
+void Profiler::set_thread_name(std::string const &name) {
+	Track &track = this_thread_track();
+	std::unique_lock< std::mutex > lock(track.name_mutex);
+	track.name = name;
+}
+
+Profiler::Track *Profiler::make_track(std::string const &name) {
+	gpu_track(); //(as in this_thread_track())
+	Track *track = get_tracks().add(name).get();
+	track->allocate();
+	return track;
+}
+
+void Profiler::use_track(Track *track) {
+	if (track) current_track = track;
+}
+
+uint64_t Profiler::now() {
+	static auto const start = std::chrono::steady_clock::now();
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count());
+}
+
+void Profiler::record(char const *name, uint64_t begin, uint64_t end) {
+	this_thread_track().add(Event{name, begin, end});
+}
+
+void Profiler::record_gpu(char const *name, uint64_t begin, uint64_t end) {
+	gpu_track().add(Event{name, begin, end});
+}
+
+void Profiler::write_trace(std::string const &filename) {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) {
+		throw std::runtime_error("Failed to open '" + filename + "' for writing a trace.");
+	}
+
+	//copy everything out first, so recording threads are never waiting on file output:
+	struct Copy {
+		uint32_t id;
+		std::string name;
+		std::vector< Event > events;
+	};
+	std::vector< Copy > copies;
+	for (auto const &track : get_tracks().copy()) {
+		copies.emplace_back();
+		Copy &copy = copies.back();
+		copy.id = track->id;
+		{
+			std::unique_lock< std::mutex > lock(track->name_mutex);
+			copy.name = track->name;
+		}
+		track->copy_events(&copy.events);
+	}
+
+	//see "Trace Event Format" (https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU):
+	// times are in microseconds; "X" events are complete zones; "M" events name threads
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	for (auto const &copy : copies) {
+		out << (first ? "" : ",\n");
+		first = false;
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << copy.id << ",\"args\":{\"name\":";
+		write_json_string(out, copy.name.empty() ? "thread " + std::to_string(copy.id) : copy.name);
+		out << "}}";
+		out << ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << copy.id << ",\"args\":{\"sort_index\":" << copy.id << "}}";
+
+		for (auto const &event : copy.events) {
+			out << ",\n{\"name\":";
+			write_json_string(out, event.name);
+			out << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << copy.id
+			    << ",\"ts\":" << (event.begin / 1000) << '.' << std::to_string(1000 + event.begin % 1000).substr(1)
+			    << ",\"dur\":" << ((event.end - event.begin) / 1000) << '.' << std::to_string(1000 + (event.end - event.begin) % 1000).substr(1)
+			    << "}";
+		}
+	}
+	out << "\n]}\n";
+
+	if (!out) {
+		throw std::runtime_error("Failed to write trace to '" + filename + "'.");
+	}
+}
+
+void Profiler::clear() {
+	//(tracks' writers aren't interrupted; events recorded so far are just skipped by write_trace())
+	for (auto const &track : get_tracks().copy()) {
+		track->cleared.store(track->recorded.load(std::memory_order_acquire), std::memory_order_relaxed);
+	}
+}
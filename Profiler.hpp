@@ -0,0 +1,101 @@
+#pragma once
+
+/*
+ * Profiler records how long things take, for viewing in a trace viewer
+ * (chrome://tracing or https://ui.perfetto.dev).
+ *
+ * CPU time is recorded by scoped zones, which can nest and can be used on any thread:
+ *
+ * void Scene::draw(...) const {
+ *     PROFILE_ZONE("Scene::draw");
+ *     ...
+ * }
+ *
+ * GPU time is recorded by GPU zones (on the thread with the OpenGL context), which
+ *  time the OpenGL commands issued while they exist using GL_TIME_ELAPSED queries:
+ *
+ * {
+ *     Profiler::GPUZone gpu_zone("draw");
+ *     Mode::current->draw(drawable_size);
+ * }
+ * Profiler::collect_gpu(); //once per frame; picks up results of finished queries
+ *
+ * Nothing is recorded until the profiler is enabled, and zones cost about one
+ *  (relaxed) atomic load when it isn't, so zones can stay in production code.
+ *
+ * Each thread keeps (only) its most recent ThreadCapacity zones, in a ring buffer
+ *  that only that thread writes, so recording a zone never takes a lock.
+ * A thread's ring buffer is allocated when it first records a zone; threads that
+ *  must not allocate (like the audio callback's) can record to a track made ahead
+ *  of time with make_track() instead.
+ *
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace Profiler {
+	//turn recording on or off:
+	void set_enabled(bool enabled);
+	extern std::atomic< bool > enabled_flag;
+	inline bool enabled() { return enabled_flag.load(std::memory_order_relaxed); }
+
+	//name the current thread in traces (otherwise threads are just numbered):
+	void set_thread_name(std::string const &name);
+
+	//a track (row in a trace) with its ring buffer already allocated:
+	struct Track;
+	Track *make_track(std::string const &name);
+	//record zones from the current thread to 'track' (doesn't lock or allocate; does nothing if track is nullptr):
+	// (call before the thread records anything, or it will already have a track of its own)
+	void use_track(Track *track);
+
+	//zones kept per thread (older zones are overwritten):
+	constexpr uint32_t ThreadCapacity = 1 << 16;
+
+	//nanoseconds since some fixed time (used for all zone times):
+	uint64_t now();
+
+	//record a zone on the current thread:
+	// (n.b. 'name' is not copied, so it should be a string literal)
+	void record(char const *name, uint64_t begin, uint64_t end);
+
+	//Zone records the time from its construction to its destruction on the current thread:
+	struct Zone {
+		Zone(char const *name_) : name(enabled() ? name_ : nullptr), begin(name ? now() : 0) { }
+		~Zone() { if (name) record(name, begin, now()); }
+		Zone(Zone const &) = delete;
+		char const *name; //(nullptr if profiler was disabled when zone started)
+		uint64_t begin;
+	};
+
+	//GPUZone records the GPU time taken by OpenGL commands issued during its lifetime:
+	// (GPU zones can't nest, since OpenGL only allows one GL_TIME_ELAPSED query at a time)
+	struct GPUZone {
+		GPUZone(char const *name);
+		~GPUZone();
+		GPUZone(GPUZone const &) = delete;
+		bool active; //(false if profiler was disabled or too many queries were in flight)
+	};
+	//read back results of finished GPU zones (call once per frame on the thread with the OpenGL context):
+	void collect_gpu();
+
+	//write everything recorded so far as a trace_event JSON file:
+	// throws on error
+	void write_trace(std::string const &filename);
+
+	//forget everything recorded so far:
+	void clear();
+
+	//internals:
+	//record a zone on the "GPU" track (used by GPUZone):
+	void record_gpu(char const *name, uint64_t begin, uint64_t end);
+}
+
+//(helpers to give each zone variable a unique name)
+#define PROFILE_ZONE_CONCAT2(A, B) A ## B
+#define PROFILE_ZONE_CONCAT(A, B) PROFILE_ZONE_CONCAT2(A, B)
+
+//time the rest of the enclosing scope:
+#define PROFILE_ZONE(NAME) Profiler::Zone PROFILE_ZONE_CONCAT(profile_zone_, __LINE__)(NAME)
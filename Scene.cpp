@@ -1,15 +1,20 @@
 #include "Scene.hpp"
 
 #include "gl_errors.hpp"
-#include "read_write_chunk.hpp"
+#include "Profiler.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
-#include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iostream>
+#include <type_traits>
 
 //-------------------------
 
-glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+//helper used by both Transform and TransformArrays:
+static glm::mat4x3 local_to_parent(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
 	//compute:
 	//   translate   *   rotate    *   scale
 	// [ 1 0 0 p.x ]   [       0 ]   [ s.x 0 0 0 ]
@@ -26,6 +31,10 @@ glm::mat4x3 Scene::Transform::make_local_to_parent() const {
 	);
 }
 
+glm::mat4x3 Scene::Transform::make_local_to_parent() const {
+	return local_to_parent(position, rotation, scale);
+}
+
 glm::mat4x3 Scene::Transform::make_parent_to_local() const {
 	//compute:
 	//   1/scale       *    rot^-1   *  translate^-1
@@ -71,6 +80,220 @@ glm::mat4x3 Scene::Transform::make_world_to_local() const {
 	}
 }
 
+uint64_t Scene::Transform::next_serial() {
+	static std::atomic< uint64_t > serial(0); //(transforms may be made on loading threads)
+	return serial.fetch_add(1, std::memory_order_relaxed);
+}
+
+//caching passes let get_local_to_world() check each transform only once while a scene is drawn:
+// (outside of a pass, every call checks the whole chain of parents, which is cheap but O(depth))
+//passes are per-thread, since scenes may be built (and their matrices computed) on loading threads;
+// pass numbers come from a shared counter so a pass on one thread never matches a pass recorded on another
+static thread_local uint32_t current_cache_pass = 0; //0 == not in a pass
+static std::atomic< uint32_t > last_cache_pass(0);
+struct CachePass {
+	CachePass() {
+		if (current_cache_pass != 0) return; //already in a pass
+		outermost = true;
+		uint32_t pass = last_cache_pass.fetch_add(1, std::memory_order_relaxed) + 1;
+		if (pass == 0) pass = last_cache_pass.fetch_add(1, std::memory_order_relaxed) + 1; //(skip zero on wrap-around)
+		current_cache_pass = pass;
+	}
+	~CachePass() {
+		if (outermost) current_cache_pass = 0;
+	}
+	bool outermost = false;
+};
+
+//every recomputed local_to_world gets a new version, so children can tell that their parent changed:
+// (atomic, since transforms in different scenes may be updated on different threads)
+static std::atomic< uint32_t > last_cache_version(0);
+static uint32_t new_cache_version() {
+	uint32_t version = last_cache_version.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (version == 0) version = last_cache_version.fetch_add(1, std::memory_order_relaxed) + 1; //(zero means "never computed")
+	return version;
+}
+
+void Scene::Transform::update_cache() const {
+	if (current_cache_pass != 0 && cache.pass == current_cache_pass) return; //already checked this pass
+
+	uint32_t parent_version = 0;
+	if (parent) {
+		parent->update_cache();
+		parent_version = parent->cache.version;
+	}
+
+	if (cache.version == 0
+	 || cache.position != position
+	 || cache.rotation != rotation
+	 || cache.scale != scale
+	 || cache.parent != parent
+	 || cache.parent_version != parent_version) {
+		cache.position = position;
+		cache.rotation = rotation;
+		cache.scale = scale;
+		cache.parent = parent;
+		cache.parent_version = parent_version;
+
+		if (!parent) {
+			cache.local_to_world = make_local_to_parent();
+		} else {
+			cache.local_to_world = parent->cache.local_to_world * glm::mat4(make_local_to_parent());
+		}
+		cache.has_world_to_local = false;
+
+		cache.version = new_cache_version();
+	}
+
+	cache.pass = current_cache_pass;
+}
+
+glm::mat4x3 const &Scene::Transform::get_local_to_world() const {
+	update_cache();
+	return cache.local_to_world;
+}
+
+glm::mat4x3 const &Scene::Transform::get_world_to_local() const {
+	update_cache();
+	if (!cache.has_world_to_local) {
+		if (!parent) {
+			cache.world_to_local = make_parent_to_local();
+		} else {
+			cache.world_to_local = make_parent_to_local() * glm::mat4(parent->get_world_to_local());
+		}
+		cache.has_world_to_local = true;
+	}
+	return cache.world_to_local;
+}
+
+//-------------------------
+
+Scene::TransformArrays::Handle Scene::TransformArrays::add(std::string const &name,
+	glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale, Handle parent) {
+
+	uint32_t parent_index = (parent ? index(parent) : -1U);
+
+	Handle handle;
+	handle.id = uint32_t(id_to_index.size());
+	id_to_index.emplace_back(uint32_t(positions.size()));
+	index_to_id.emplace_back(handle.id);
+
+	//(new transforms go at the end, so are always after their parent)
+	positions.emplace_back(position);
+	rotations.emplace_back(rotation);
+	scales.emplace_back(scale);
+	parents.emplace_back(parent_index);
+	names.emplace_back(name);
+	local_to_worlds.emplace_back(local_to_parent(position, rotation, scale));
+	versions.emplace_back(0);
+
+	return handle;
+}
+
+Scene::TransformArrays::Handle Scene::TransformArrays::parent(Handle handle) const {
+	uint32_t parent_index = parents[index(handle)];
+	Handle ret;
+	if (parent_index != -1U) ret.id = index_to_id[parent_index];
+	return ret;
+}
+
+void Scene::TransformArrays::set_parent(Handle handle, Handle parent) {
+	uint32_t i = index(handle);
+	uint32_t parent_index = (parent ? index(parent) : -1U);
+
+	//make sure transform isn't becoming its own ancestor:
+	for (uint32_t a = parent_index; a != -1U; a = parents[a]) {
+		if (a == i) {
+			throw std::runtime_error("Setting parent of transform '" + names[i] + "' to '" + names[parent_index] + "' would create a cycle.");
+		}
+	}
+
+	parents[i] = parent_index;
+	if (parent_index != -1U && parent_index > i) sort();
+}
+
+void Scene::TransformArrays::sort() {
+	uint32_t count = uint32_t(size());
+
+	//gather children of each transform (as contiguous ranges of one array):
+	std::vector< uint32_t > child_begin(count + 1, 0);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (parents[i] != -1U) child_begin[parents[i] + 1] += 1;
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		child_begin[i + 1] += child_begin[i];
+	}
+	std::vector< uint32_t > children(child_begin[count]);
+	{
+		std::vector< uint32_t > next = child_begin;
+		for (uint32_t i = 0; i < count; ++i) {
+			if (parents[i] != -1U) children[next[parents[i]]++] = i;
+		}
+	}
+
+	//breadth-first from the roots puts every parent before its children:
+	// (and otherwise keeps the current order as much as possible)
+	std::vector< uint32_t > order;
+	order.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		if (parents[i] == -1U) order.emplace_back(i);
+	}
+	for (uint32_t o = 0; o < order.size(); ++o) {
+		for (uint32_t c = child_begin[order[o]]; c < child_begin[order[o] + 1]; ++c) {
+			order.emplace_back(children[c]);
+		}
+	}
+	assert(order.size() == count && "set_parent() prevents cycles, so every transform is reachable from a root");
+
+	std::vector< uint32_t > new_index(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		new_index[order[i]] = i;
+	}
+
+	//apply the new order to every array:
+	auto permute = [&order](auto &array) {
+		typename std::remove_reference< decltype(array) >::type sorted;
+		sorted.reserve(array.size());
+		for (uint32_t old : order) {
+			sorted.emplace_back(std::move(array[old]));
+		}
+		array = std::move(sorted);
+	};
+	permute(positions);
+	permute(rotations);
+	permute(scales);
+	permute(names);
+	permute(local_to_worlds);
+	permute(versions);
+	permute(index_to_id);
+	permute(parents);
+	for (auto &p : parents) {
+		if (p != -1U) p = new_index[p];
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		id_to_index[index_to_id[i]] = i;
+	}
+}
+
+void Scene::TransformArrays::update() const {
+	assert(local_to_worlds.size() == positions.size());
+	assert(versions.size() == positions.size());
+	for (uint32_t i = 0; i < positions.size(); ++i) {
+		glm::mat4x3 local = local_to_parent(positions[i], rotations[i], scales[i]);
+		glm::mat4x3 local_to_world;
+		if (parents[i] == -1U) {
+			local_to_world = local;
+		} else {
+			assert(parents[i] < i);
+			local_to_world = local_to_worlds[parents[i]] * glm::mat4(local); //note: glm::mat4(glm::mat4x3) pads with a (0,0,0,1) row
+		}
+		if (versions[i] == 0 || local_to_world != local_to_worlds[i]) {
+			local_to_worlds[i] = local_to_world;
+			versions[i] = new_cache_version();
+		}
+	}
+}
+
 //-------------------------
 
 glm::mat4 Scene::Camera::make_projection() const {
@@ -80,43 +303,425 @@ glm::mat4 Scene::Camera::make_projection() const {
 //-------------------------
 
 
+//buffer that per-instance data is streamed through (shared by all scenes; created on first use):
+static GLuint get_instance_buffer() {
+	static GLuint buffer = 0;
+	if (buffer == 0) {
+		glGenBuffers(1, &buffer);
+	}
+	return buffer;
+}
+
+GLuint Scene::make_instance_vao(GLuint program) {
+	GLint object_to_world = glGetAttribLocation(program, "OBJECT_TO_WORLD");
+	if (object_to_world == -1) {
+		throw std::runtime_error("Instanced program doesn't have an OBJECT_TO_WORLD attribute.");
+	}
+	GLint normal_to_world = glGetAttribLocation(program, "NORMAL_TO_WORLD"); //(optional)
+
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+	glBindBuffer(GL_ARRAY_BUFFER, get_instance_buffer());
+
+	//matrix attributes take one location per column:
+	for (GLuint c = 0; c < 4; ++c) {
+		GLuint location = GLuint(object_to_world) + c;
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLbyte *)0 + offsetof(InstanceData, object_to_world) + c * sizeof(glm::vec3));
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1); //advance once per instance instead of once per vertex
+	}
+	if (normal_to_world != -1) {
+		for (GLuint c = 0; c < 3; ++c) {
+			GLuint location = GLuint(normal_to_world) + c;
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (GLbyte *)0 + offsetof(InstanceData, normal_to_world) + c * sizeof(glm::vec3));
+			glEnableVertexAttribArray(location);
+			glVertexAttribDivisor(location, 1);
+		}
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	GL_ERRORS();
+
+	return vao;
+}
+
 void Scene::draw(Camera const &camera) const {
 	assert(camera.transform);
-	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->make_world_to_local());
+	CachePass pass; //(so transforms shared by the camera and drawables are only checked once)
+	glm::mat4 world_to_clip = camera.make_projection() * glm::mat4(camera.transform->get_world_to_local());
 	glm::mat4x3 world_to_light = glm::mat4x3(1.0f);
 	draw(world_to_clip, world_to_light);
 }
 
-void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+//Figure out the planes of the view frustum (in world space) of a world_to_clip matrix:
+// (see Gribb and Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix")
+// a point p is inside plane (n,d) when dot(n,p) + d >= 0; returns number of planes
+static uint32_t get_frustum_planes(glm::mat4 const &world_to_clip, glm::vec4 planes[6]) {
+	auto row = [&world_to_clip](int r) {
+		return glm::vec4(world_to_clip[0][r], world_to_clip[1][r], world_to_clip[2][r], world_to_clip[3][r]);
+	};
+	glm::vec4 candidates[6] = {
+		row(3) + row(0), row(3) - row(0), //left, right
+		row(3) + row(1), row(3) - row(1), //bottom, top
+		row(3) + row(2), row(3) - row(2), //near, far
+	};
+	uint32_t plane_count = 0;
+	for (auto const &plane : candidates) {
+		float length = glm::length(glm::vec3(plane));
+		//skip degenerate planes (e.g., the far plane of Camera::make_projection's infinite perspective):
+		if (length < 1e-6f) continue;
+		planes[plane_count++] = plane / length;
+	}
+	return plane_count;
+}
+
+//number of triangles drawn by a draw call:
+static uint32_t count_triangles(GLenum type, GLuint count) {
+	if (type == GL_TRIANGLES) return count / 3;
+	if ((type == GL_TRIANGLE_STRIP || type == GL_TRIANGLE_FAN) && count >= 3) return count - 2;
+	return 0;
+}
+
+//offset (as glDrawElements wants it) of the first index drawn by an indexed pipeline:
+static void const *index_offset(Scene::Drawable::Pipeline const &pipeline) {
+	GLsizeiptr size = (pipeline.index_type == GL_UNSIGNED_INT ? 4 : pipeline.index_type == GL_UNSIGNED_SHORT ? 2 : 1);
+	return (GLbyte *)0 + pipeline.start * size;
+}
+
+//object_to_x with quantized positions (see Pipeline::position_scale) taken to object space first:
+static glm::mat4x3 with_position_to_object(Scene::Drawable::Pipeline const &pipeline, glm::mat4x3 const &object_to_x) {
+	//(scale columns, then move origin; same as object_to_x * position_to_object, without the zeros)
+	return glm::mat4x3(
+		object_to_x[0] * pipeline.position_scale.x,
+		object_to_x[1] * pipeline.position_scale.y,
+		object_to_x[2] * pipeline.position_scale.z,
+		object_to_x * glm::vec4(pipeline.position_offset, 1.0f)
+	);
+}
+
+static bool has_bounds(Scene::Drawable const &drawable) {
+	Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+	return pipeline.min.x <= pipeline.max.x && pipeline.min.y <= pipeline.max.y && pipeline.min.z <= pipeline.max.z;
+}
+
+void Scene::update_bvh() const {
+	PROFILE_ZONE("Scene::update_bvh");
+	CachePass pass;
+	//(transforms stored in arrays are just all updated)
+	transform_arrays.update();
+
+	//does the bvh have a leaf for this drawable?
+	// (n.b. copied drawables carry the leaf of the drawable they were copied from, so also check the leaf's data)
+	auto in_bvh = [this](Drawable const &drawable) {
+		return bvh.contains(drawable.bvh_leaf) && bvh.data(drawable.bvh_leaf) == &drawable;
+	};
 
-	//Iterate through all drawables, sending each one to OpenGL:
+	//add or move leaves for drawables with bounds, noting which leaves are still in use:
+	bvh_keep.assign(bvh.nodes.size(), false);
+	uint32_t kept = 0;
+	unbounded_drawables.clear();
+	uint32_t order = 0;
 	for (auto const &drawable : drawables) {
-		//Reference to drawable's pipeline for convenience:
-		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+		drawable.order = order++;
+		if (!has_bounds(drawable)) {
+			drawable.bvh_leaf = -1U; //(any leaf it had is removed below)
+			unbounded_drawables.emplace_back(&drawable);
+			continue;
+		}
+
+		assert(drawable.transform || drawable.handle); //drawables *must* have a transform
+		glm::mat4x3 const &object_to_world = (drawable.transform
+			? drawable.transform->get_local_to_world()
+			: transform_arrays.local_to_world(drawable.handle) );
+		uint32_t version = (drawable.transform ? drawable.transform->cache.version : transform_arrays.version(drawable.handle));
+		Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+		bool inserted = in_bvh(drawable);
+		//(only drawables whose world matrix or bounds changed since the last update need their leaf moved)
+		if (inserted && version == drawable.world_version
+		 && pipeline.min == drawable.world_from_min && pipeline.max == drawable.world_from_max) {
+			bvh_keep[drawable.bvh_leaf] = true;
+			kept += 1;
+			continue;
+		}
+
+		//get a world-space box containing the object-space box:
+		glm::vec3 center = object_to_world * glm::vec4(0.5f * (pipeline.max + pipeline.min), 1.0f);
+		glm::vec3 half = 0.5f * (pipeline.max - pipeline.min);
+		glm::mat3 abs_rot = glm::mat3(glm::abs(object_to_world[0]), glm::abs(object_to_world[1]), glm::abs(object_to_world[2]));
+		glm::vec3 radius = abs_rot * half;
+		drawable.world_min = center - radius;
+		drawable.world_max = center + radius;
+		drawable.world_version = version;
+		drawable.world_from_min = pipeline.min;
+		drawable.world_from_max = pipeline.max;
+
+		if (inserted) {
+			bvh.move(drawable.bvh_leaf, drawable.world_min, drawable.world_max);
+		} else {
+			drawable.bvh_leaf = bvh.insert(drawable.world_min, drawable.world_max, &drawable);
+			if (drawable.bvh_leaf >= bvh_keep.size()) bvh_keep.resize(bvh.nodes.size(), false);
+		}
+		bvh_keep[drawable.bvh_leaf] = true;
+		kept += 1;
+	}
+
+	//remove leaves for drawables that are gone (or no longer have bounds):
+	// (only needs a look through the leaves if some weren't kept above)
+	if (kept < bvh.size()) {
+		for (uint32_t leaf = 0; leaf < bvh_keep.size(); ++leaf) {
+			if (!bvh_keep[leaf] && bvh.contains(leaf)) bvh.remove(leaf);
+		}
+	}
+}
+
+void Scene::query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable const * > *out) const {
+	assert(out);
+	bvh.query_box(min, max, [&](uint32_t leaf){
+		Drawable const *drawable = reinterpret_cast< Drawable const * >(bvh.data(leaf));
+		//(leaf boxes are a bit bigger than drawable bounds, so check the actual bounds)
+		if (drawable->world_min.x <= max.x && drawable->world_min.y <= max.y && drawable->world_min.z <= max.z
+		 && min.x <= drawable->world_max.x && min.y <= drawable->world_max.y && min.z <= drawable->world_max.z) {
+			out->emplace_back(drawable);
+		}
+	});
+}
+
+void Scene::query_frustum(glm::mat4 const &world_to_clip, std::vector< Drawable const * > *out) const {
+	assert(out);
+	glm::vec4 planes[6];
+	uint32_t plane_count = get_frustum_planes(world_to_clip, planes);
+	bvh.query_planes(planes, plane_count, [&](uint32_t leaf){
+		Drawable const *drawable = reinterpret_cast< Drawable const * >(bvh.data(leaf));
+		//(leaf boxes are a bit bigger than drawable bounds, so check the actual bounds)
+		glm::vec3 center = 0.5f * (drawable->world_max + drawable->world_min);
+		glm::vec3 radius = 0.5f * (drawable->world_max - drawable->world_min);
+		for (uint32_t p = 0; p < plane_count; ++p) {
+			glm::vec3 normal = glm::vec3(planes[p]);
+			if (glm::dot(normal, center) + planes[p].w + glm::dot(glm::abs(normal), radius) < 0.0f) return;
+		}
+		out->emplace_back(drawable);
+	});
+}
+
+Scene::Drawable const *Scene::ray_cast(glm::vec3 const &origin, glm::vec3 const &direction, float max_t, float *hit_t) const {
+	Drawable const *closest = nullptr;
+	glm::vec3 inv_direction = 1.0f / direction;
+	bvh.query_ray(origin, direction, max_t, [&](uint32_t leaf, float) {
+		Drawable const *drawable = reinterpret_cast< Drawable const * >(bvh.data(leaf));
+		//(leaf boxes are a bit bigger than drawable bounds, so check the actual bounds)
+		glm::vec3 t0 = (drawable->world_min - origin) * inv_direction;
+		glm::vec3 t1 = (drawable->world_max - origin) * inv_direction;
+		glm::vec3 t_min = glm::min(t0, t1);
+		glm::vec3 t_max = glm::max(t0, t1);
+		float t_enter = std::max(std::max(t_min.x, t_min.y), std::max(t_min.z, 0.0f));
+		float t_exit = std::min(std::min(t_max.x, t_max.y), std::min(t_max.z, max_t));
+		if (t_enter <= t_exit) {
+			closest = drawable;
+			max_t = t_enter;
+		}
+		return max_t;
+	});
+	if (closest && hit_t) *hit_t = max_t;
+	return closest;
+}
+
+void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light) const {
+	PROFILE_ZONE("Scene::draw");
+	//check each transform's cached matrices at most once while drawing:
+	CachePass pass;
+
+	draw_stats = DrawStats();
 
+	auto get_object_to_world = [this](Drawable const &drawable) -> glm::mat4x3 const & {
+		assert(drawable.transform || drawable.handle); //drawables *must* have a transform
+		return (drawable.transform
+			? drawable.transform->get_local_to_world()
+			: transform_arrays.local_to_world(drawable.handle) );
+	};
+
+	//Gather (visible) drawables into a render queue:
+	// (drawables with bounds are found by a frustum query on the bvh; drawables without bounds are always drawn)
+	update_bvh();
+	draw_queue.clear();
+	query_frustum(world_to_clip, &draw_queue);
+	draw_stats.culled = bvh.size() - uint32_t(draw_queue.size());
+	draw_queue.insert(draw_queue.end(), unbounded_drawables.begin(), unbounded_drawables.end());
+
+	draw_queue.erase(std::remove_if(draw_queue.begin(), draw_queue.end(), [](Drawable const *drawable){
 		//skip any drawables without a shader program set:
-		if (pipeline.program == 0) continue;
+		if (drawable->pipeline.program == 0) return true;
 		//skip any drawables that don't reference any vertex array:
-		if (pipeline.vao == 0) continue;
+		if (drawable->pipeline.vao == 0) return true;
 		//skip any drawables that don't contain any vertices:
-		if (pipeline.count == 0) continue;
+		if (drawable->pipeline.count == 0) return true;
+		return false;
+	}), draw_queue.end());
+	draw_stats.visible = uint32_t(draw_queue.size());
+
+	//Sort the queue so that drawables sharing a program, vertex array, and textures are drawn together:
+	// (drawables that share all of these still draw in the order they appear in 'drawables')
+	std::sort(draw_queue.begin(), draw_queue.end(), [](Drawable const *a_, Drawable const *b_) {
+		Drawable::Pipeline const &a = a_->pipeline;
+		Drawable::Pipeline const &b = b_->pipeline;
+		if (a.program != b.program) return a.program < b.program;
+		if (a.vao != b.vao) return a.vao < b.vao;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (a.textures[i].texture != b.textures[i].texture) return a.textures[i].texture < b.textures[i].texture;
+			if (a.textures[i].target != b.textures[i].target) return a.textures[i].target < b.textures[i].target;
+		}
+		//(also group copies of the same mesh, so they can be instanced)
+		if (a.instanced.program != b.instanced.program) return a.instanced.program < b.instanced.program;
+		if (a.instanced.vao != b.instanced.vao) return a.instanced.vao < b.instanced.vao;
+		if (a.type != b.type) return a.type < b.type;
+		if (a.start != b.start) return a.start < b.start;
+		if (a.count != b.count) return a.count < b.count;
+		if (a.index_type != b.index_type) return a.index_type < b.index_type;
+		return a_->order < b_->order;
+	});
+
+	//can two drawables be drawn by the same instanced draw call?
+	auto same_instance_batch = [](Drawable::Pipeline const &a, Drawable::Pipeline const &b) {
+		if (a.instanced.program == 0 || a.instanced.vao == 0) return false;
+		if (a.set_uniforms || b.set_uniforms) return false; //(custom uniforms may differ per-drawable)
+		if (a.program != b.program || a.vao != b.vao) return false;
+		if (a.instanced.program != b.instanced.program || a.instanced.vao != b.instanced.vao) return false;
+		if (a.type != b.type || a.start != b.start || a.count != b.count || a.index_type != b.index_type) return false;
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			if (a.textures[i].texture != b.textures[i].texture || a.textures[i].target != b.textures[i].target) return false;
+		}
+		return true;
+	};
+
+	//Track bound state so that only changes need to be sent to OpenGL:
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
+	Drawable::Pipeline::TextureInfo bound_textures[Drawable::Pipeline::TextureCount];
+
+	auto use_program = [&](GLuint program) {
+		if (program != bound_program) {
+			glUseProgram(program);
+			bound_program = program;
+			draw_stats.program_changes += 1;
+			draw_stats.elided_state_changes -= 1;
+		}
+	};
+
+	auto bind_vao = [&](GLuint vao) {
+		if (vao != bound_vao) {
+			glBindVertexArray(vao);
+			bound_vao = vao;
+			draw_stats.vao_changes += 1;
+			draw_stats.elided_state_changes -= 1;
+		}
+	};
 
+	//set up textures (only where they differ from what is already bound):
+	auto bind_textures = [&](Drawable::Pipeline const &pipeline) {
+		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+			Drawable::Pipeline::TextureInfo const &want = pipeline.textures[i];
+			Drawable::Pipeline::TextureInfo &bound = bound_textures[i];
+			if (want.texture == bound.texture && (want.texture == 0 || want.target == bound.target)) continue;
+			glActiveTexture(GL_TEXTURE0 + i);
+			if (bound.texture != 0 && (want.texture == 0 || want.target != bound.target)) {
+				//un-bind old texture (so drawables without a texture here don't see it):
+				glBindTexture(bound.target, 0);
+				draw_stats.texture_changes += 1;
+				draw_stats.elided_state_changes -= 1;
+			}
+			if (want.texture != 0) {
+				glBindTexture(want.target, want.texture);
+				draw_stats.texture_changes += 1;
+				draw_stats.elided_state_changes -= 1;
+			}
+			bound = want;
+		}
+	};
+
+	//Iterate through the queue, sending drawables to OpenGL:
+	for (size_t q = 0; q < draw_queue.size(); /* later */) {
+		Drawable const &drawable = *draw_queue[q];
+		//Reference to drawable's pipeline for convenience:
+		Scene::Drawable::Pipeline const &pipeline = drawable.pipeline;
+
+		//find all following drawables that can be drawn along with this one:
+		size_t end = q + 1;
+		while (end < draw_queue.size() && same_instance_batch(pipeline, draw_queue[end]->pipeline)) {
+			++end;
+		}
+
+		//(what drawing each drawable on its own used to cost: program, vertex array, plus bind+unbind per texture)
+		for (size_t i = q; i < end; ++i) {
+			draw_stats.elided_state_changes += 2;
+			for (uint32_t t = 0; t < Drawable::Pipeline::TextureCount; ++t) {
+				if (draw_queue[i]->pipeline.textures[t].texture != 0) draw_stats.elided_state_changes += 2;
+			}
+		}
+		draw_stats.draws += 1;
+
+		if (end - q > 1) {
+			//many copies of the same thing -- draw them all at once:
+			instance_data.clear();
+			for (size_t i = q; i < end; ++i) {
+				glm::mat4x3 const &object_to_world = get_object_to_world(*draw_queue[i]);
+				instance_data.emplace_back(InstanceData{
+					with_position_to_object(pipeline, object_to_world),
+					glm::inverse(glm::transpose(glm::mat3(object_to_world)))
+				});
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, get_instance_buffer());
+			glBufferData(GL_ARRAY_BUFFER, instance_data.size() * sizeof(InstanceData), instance_data.data(), GL_STREAM_DRAW); //(re-specifying the whole buffer means the driver doesn't need to wait for the previous draw)
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-		//Set shader program:
-		glUseProgram(pipeline.program);
+			use_program(pipeline.instanced.program);
+			bind_vao(pipeline.instanced.vao);
 
-		//Set attribute sources:
-		glBindVertexArray(pipeline.vao);
+			//WORLD_TO_CLIP takes vertices from world space to clip space:
+			if (pipeline.instanced.WORLD_TO_CLIP_mat4 != -1U) {
+				glUniformMatrix4fv(pipeline.instanced.WORLD_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(world_to_clip));
+			}
+			//WORLD_TO_LIGHT takes vertices from world space to light space:
+			if (pipeline.instanced.WORLD_TO_LIGHT_mat4x3 != -1U) {
+				glUniformMatrix4x3fv(pipeline.instanced.WORLD_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(world_to_light));
+			}
+			//NORMAL_WORLD_TO_LIGHT takes normals from world space to light space:
+			if (pipeline.instanced.NORMAL_WORLD_TO_LIGHT_mat3 != -1U) {
+				glm::mat3 normal_world_to_light = glm::inverse(glm::transpose(glm::mat3(world_to_light)));
+				glUniformMatrix3fv(pipeline.instanced.NORMAL_WORLD_TO_LIGHT_mat3, 1, GL_FALSE, glm::value_ptr(normal_world_to_light));
+			}
+
+			bind_textures(pipeline);
+
+			//draw the objects:
+			if (pipeline.index_type != GL_NONE) {
+				glDrawElementsInstanced(pipeline.type, pipeline.count, pipeline.index_type, index_offset(pipeline), GLsizei(end - q));
+			} else {
+				glDrawArraysInstanced(pipeline.type, pipeline.start, pipeline.count, GLsizei(end - q));
+			}
+
+			draw_stats.instanced_draws += 1;
+			draw_stats.instances += uint32_t(end - q);
+			draw_stats.triangles += count_triangles(pipeline.type, pipeline.count) * uint32_t(end - q);
+
+			q = end;
+			continue;
+		}
+
+		use_program(pipeline.program);
+		bind_vao(pipeline.vao);
 
 		//Configure program uniforms:
 
 		//the object-to-world matrix is used in all three of these uniforms:
-		assert(drawable.transform); //drawables *must* have a transform
-		glm::mat4x3 object_to_world = drawable.transform->make_local_to_world();
+		glm::mat4x3 const &object_to_world = get_object_to_world(drawable);
 
 		//OBJECT_TO_CLIP takes vertices from object space to clip space:
+		// (and first from quantized positions to object space, if the pipeline's positions are quantized)
 		if (pipeline.OBJECT_TO_CLIP_mat4 != -1U) {
-			glm::mat4 object_to_clip = world_to_clip * glm::mat4(object_to_world);
+			glm::mat4 object_to_clip = world_to_clip * glm::mat4(with_position_to_object(pipeline, object_to_world));
 			glUniformMatrix4fv(pipeline.OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip));
 		}
 
@@ -125,7 +730,8 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 
 		//OBJECT_TO_CLIP takes vertices from object space to light space:
 		if (pipeline.OBJECT_TO_LIGHT_mat4x3 != -1U) {
-			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(object_to_light));
+			glm::mat4x3 position_to_light = with_position_to_object(pipeline, object_to_light);
+			glUniformMatrix4x3fv(pipeline.OBJECT_TO_LIGHT_mat4x3, 1, GL_FALSE, glm::value_ptr(position_to_light));
 		}
 
 		//NORMAL_TO_CLIP takes normals from object space to light space:
@@ -137,27 +743,29 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 		//set any requested custom uniforms:
 		if (pipeline.set_uniforms) pipeline.set_uniforms();
 
-		//set up textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, pipeline.textures[i].texture);
-			}
-		}
+		bind_textures(pipeline);
 
 		//draw the object:
-		glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
-
-		//un-bind textures:
-		for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
-			if (pipeline.textures[i].texture != 0) {
-				glActiveTexture(GL_TEXTURE0 + i);
-				glBindTexture(pipeline.textures[i].target, 0);
-			}
+		if (pipeline.index_type != GL_NONE) {
+			glDrawElements(pipeline.type, pipeline.count, pipeline.index_type, index_offset(pipeline));
+		} else {
+			glDrawArrays(pipeline.type, pipeline.start, pipeline.count);
 		}
-		glActiveTexture(GL_TEXTURE0);
+		draw_stats.triangles += count_triangles(pipeline.type, pipeline.count);
 
+		q = end;
+	}
+
+	//un-bind textures:
+	for (uint32_t i = 0; i < Drawable::Pipeline::TextureCount; ++i) {
+		if (bound_textures[i].texture != 0) {
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(bound_textures[i].target, 0);
+			draw_stats.texture_changes += 1;
+			draw_stats.elided_state_changes -= 1;
+		}
 	}
+	glActiveTexture(GL_TEXTURE0);
 
 	glUseProgram(0);
 	glBindVertexArray(0);
@@ -169,10 +777,11 @@ void Scene::draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_lig
 void Scene::load(std::string const &filename,
 	std::function< void(Scene &, Transform *, std::string const &) > const &on_drawable) {
 
-	std::ifstream file(filename, std::ios::binary);
+	//(the file is mapped and its tables are parsed in place, except where they aren't aligned, as in files from older exporters)
+	// chunks are looked up by magic number, so their order doesn't matter and chunks for load_extra() (or unknown ones) are skipped
+	ChunkFile file(filename);
 
-	std::vector< char > names;
-	read_chunk(file, "str0", &names);
+	ChunkFile::Span< char > names = file.view< char >("str0");
 
 	struct HierarchyEntry {
 		uint32_t parent;
@@ -183,8 +792,8 @@ void Scene::load(std::string const &filename,
 		glm::vec3 scale;
 	};
 	static_assert(sizeof(HierarchyEntry) == 4 + 4 + 4 + 4*3 + 4*4 + 4*3, "HierarchyEntry is packed.");
-	std::vector< HierarchyEntry > hierarchy;
-	read_chunk(file, "xfh0", &hierarchy);
+	std::vector< HierarchyEntry > hierarchy_fallback;
+	ChunkFile::Span< HierarchyEntry > hierarchy = file.view< HierarchyEntry >("xfh0", &hierarchy_fallback);
 
 	struct MeshEntry {
 		uint32_t transform;
@@ -192,8 +801,8 @@ void Scene::load(std::string const &filename,
 		uint32_t name_end;
 	};
 	static_assert(sizeof(MeshEntry) == 4 + 4 + 4, "MeshEntry is packed.");
-	std::vector< MeshEntry > meshes;
-	read_chunk(file, "msh0", &meshes);
+	std::vector< MeshEntry > meshes_fallback;
+	ChunkFile::Span< MeshEntry > meshes = file.view< MeshEntry >("msh0", &meshes_fallback);
 
 	struct CameraEntry {
 		uint32_t transform;
@@ -202,8 +811,8 @@ void Scene::load(std::string const &filename,
 		float clip_near, clip_far;
 	};
 	static_assert(sizeof(CameraEntry) == 4 + 4 + 4 + 4 + 4, "CameraEntry is packed.");
-	std::vector< CameraEntry > loaded_cameras;
-	read_chunk(file, "cam0", &loaded_cameras);
+	std::vector< CameraEntry > cameras_fallback;
+	ChunkFile::Span< CameraEntry > loaded_cameras = file.view< CameraEntry >("cam0", &cameras_fallback);
 
 	struct LightEntry {
 		uint32_t transform;
@@ -214,8 +823,8 @@ void Scene::load(std::string const &filename,
 		float fov;
 	};
 	static_assert(sizeof(LightEntry) == 4 + 1 + 3 + 4 + 4 + 4, "LightEntry is packed.");
-	std::vector< LightEntry > loaded_lights;
-	read_chunk(file, "lmp0", &loaded_lights);
+	std::vector< LightEntry > lights_fallback;
+	ChunkFile::Span< LightEntry > loaded_lights = file.view< LightEntry >("lmp0", &lights_fallback);
 
 
 	//--------------------------------
@@ -235,7 +844,7 @@ void Scene::load(std::string const &filename,
 		}
 
 		if (h.name_begin <= h.name_end && h.name_end <= names.size()) {
-			t->name = std::string(names.begin() + h.name_begin, names.begin() + h.name_end);
+			t->name = std::string(names.data() + h.name_begin, names.data() + h.name_end);
 		} else {
 				throw std::runtime_error("scene file '" + filename + "' contains hierarchy entry with invalid name indices");
 		}
@@ -255,7 +864,7 @@ void Scene::load(std::string const &filename,
 		if (!(m.name_begin <= m.name_end && m.name_end <= names.size())) {
 			throw std::runtime_error("scene file '" + filename + "' contains mesh entry with invalid name indices");
 		}
-		std::string name = std::string(names.begin() + m.name_begin, names.begin() + m.name_end);
+		std::string name = std::string(names.data() + m.name_begin, names.data() + m.name_end);
 
 		if (on_drawable) {
 			on_drawable(*this, hierarchy_transforms[m.transform], name);
@@ -304,10 +913,6 @@ void Scene::load(std::string const &filename,
 	//load any extra that a subclass wants:
 	load_extra(file, names, hierarchy_transforms);
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in scene file '" << filename << "'" << std::endl;
-	}
-
 
 
 }
@@ -327,51 +932,212 @@ Scene &Scene::operator=(Scene const &other) {
 	return *this;
 }
 
-void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map_) {
-
-	std::unordered_map< Transform const *, Transform * > t2t_temp;
-	std::unordered_map< Transform const *, Transform * > &transform_to_transform = *(transform_map_ ? transform_map_ : &t2t_temp);
-
-	transform_to_transform.clear();
+void Scene::set(Scene const &other, std::unordered_map< Transform const *, Transform * > *transform_map) {
 
-	//null transform maps to itself:
-	transform_to_transform.insert(std::make_pair(nullptr, nullptr));
-
-	//Copy transforms and store mapping:
+	//Copy transforms, keeping track of where each original went:
 	transforms.clear();
+	std::vector< Transform const * > old_transforms;
+	std::vector< Transform * > new_transforms;
+	old_transforms.reserve(other.transforms.size());
+	new_transforms.reserve(other.transforms.size());
 	for (auto const &t : other.transforms) {
+		old_transforms.emplace_back(&t);
+
 		transforms.emplace_back();
 		transforms.back().name = t.name;
 		transforms.back().position = t.position;
 		transforms.back().rotation = t.rotation;
 		transforms.back().scale = t.scale;
-		transforms.back().parent = t.parent; //will update later
+		new_transforms.emplace_back(&transforms.back());
+	}
 
-		//store mapping between transforms old and new:
-		auto ret = transform_to_transform.insert(std::make_pair(&t, &transforms.back()));
-		assert(ret.second);
+	//pointer -> index lookup for other's transforms, by serial number:
+	// transforms made together (e.g., by load() or set()) have consecutive serials, so this is usually a table
+	// with about one entry per transform, filled in one pass; if the serials are spread out too far for that,
+	// a sorted array of (serial, index) pairs is searched instead
+	uint64_t min_serial = std::numeric_limits< uint64_t >::max();
+	uint64_t max_serial = 0;
+	for (Transform const *t : old_transforms) {
+		min_serial = std::min(min_serial, t->serial);
+		max_serial = std::max(max_serial, t->serial);
 	}
+	std::vector< uint32_t > serial_to_index; //[serial - min_serial] -> index (or -1U)
+	std::vector< std::pair< uint64_t, uint32_t > > sorted_serials; //(only if serial_to_index would be too big)
+	if (!old_transforms.empty() && max_serial - min_serial < 4 * uint64_t(old_transforms.size()) + 64) {
+		serial_to_index.assign(size_t(max_serial - min_serial + 1), -1U);
+		for (uint32_t i = 0; i < old_transforms.size(); ++i) {
+			serial_to_index[size_t(old_transforms[i]->serial - min_serial)] = i;
+		}
+	} else {
+		sorted_serials.reserve(old_transforms.size());
+		for (uint32_t i = 0; i < old_transforms.size(); ++i) {
+			sorted_serials.emplace_back(old_transforms[i]->serial, i);
+		}
+		std::sort(sorted_serials.begin(), sorted_serials.end());
+	}
+
+	//translate a pointer to one of other's transforms into a pointer to one of ours:
+	auto translate = [&](Transform const *t) -> Transform * {
+		if (t == nullptr) return nullptr;
+		uint32_t index = -1U;
+		if (!serial_to_index.empty()) {
+			if (t->serial >= min_serial && t->serial <= max_serial) index = serial_to_index[size_t(t->serial - min_serial)];
+		} else {
+			auto f = std::lower_bound(sorted_serials.begin(), sorted_serials.end(), std::make_pair(t->serial, 0U));
+			if (f != sorted_serials.end() && f->first == t->serial) index = f->second;
+		}
+		//(check that the index is really ours, in case of a pointer to a transform from some other scene)
+		if (!(index < old_transforms.size() && old_transforms[index] == t)) {
+			throw std::out_of_range("Scene references a transform that isn't in the scene.");
+		}
+		return new_transforms[index];
+	};
 
 	//update transform parents:
-	for (auto &t : transforms) {
-		t.parent = transform_to_transform.at(t.parent);
+	{
+		auto new_t = transforms.begin();
+		for (auto const &t : other.transforms) {
+			new_t->parent = translate(t.parent);
+			++new_t;
+		}
 	}
 
+	//transforms stored in arrays are referenced by handles, so need no fixup:
+	transform_arrays = other.transform_arrays;
+
 	//copy other's drawables, updating transform pointers:
 	drawables = other.drawables;
 	for (auto &d : drawables) {
-		d.transform = transform_to_transform.at(d.transform);
+		d.transform = translate(d.transform); //(nullptr for drawables using transform_arrays)
 	}
+	//(the bvh refers to drawables by pointer, so is rebuilt by the next update_bvh())
+	bvh.clear();
+	unbounded_drawables.clear();
 
 	//copy other's cameras, updating transform pointers:
 	cameras = other.cameras;
 	for (auto &c : cameras) {
-		c.transform = transform_to_transform.at(c.transform);
+		c.transform = translate(c.transform);
 	}
 
 	//copy other's lights, updating transform pointers:
 	lights = other.lights;
 	for (auto &l : lights) {
-		l.transform = transform_to_transform.at(l.transform);
+		l.transform = translate(l.transform);
+	}
+
+	//if asked, also provide the old -> new transform mapping:
+	if (transform_map) {
+		transform_map->clear();
+		transform_map->insert(std::make_pair(nullptr, nullptr));
+		for (uint32_t i = 0; i < old_transforms.size(); ++i) {
+			transform_map->insert(std::make_pair(old_transforms[i], new_transforms[i]));
+		}
+	}
+}
+
+Scene::Snapshot Scene::snapshot() const {
+	Snapshot ret;
+	snapshot(&ret);
+	return ret;
+}
+
+void Scene::snapshot(Snapshot *into) const {
+	assert(into);
+	into->transforms.clear();
+	into->transforms.reserve(transforms.size());
+	for (auto const &t : transforms) {
+		into->transforms.emplace_back(Snapshot::TransformState{t.position, t.rotation, t.scale, t.parent});
+	}
+	into->transform_arrays.positions.assign(transform_arrays.positions.begin(), transform_arrays.positions.end());
+	into->transform_arrays.rotations.assign(transform_arrays.rotations.begin(), transform_arrays.rotations.end());
+	into->transform_arrays.scales.assign(transform_arrays.scales.begin(), transform_arrays.scales.end());
+	into->transform_arrays.parents.assign(transform_arrays.parents.begin(), transform_arrays.parents.end());
+	into->transform_arrays.index_to_id.assign(transform_arrays.index_to_id.begin(), transform_arrays.index_to_id.end());
+}
+
+void Scene::restore(Snapshot const &snapshot) {
+	if (snapshot.transforms.size() != transforms.size()) {
+		throw std::runtime_error("Snapshot has " + std::to_string(snapshot.transforms.size()) + " transforms, but scene has " + std::to_string(transforms.size()) + ".");
+	}
+	if (snapshot.transform_arrays.index_to_id != transform_arrays.index_to_id) {
+		throw std::runtime_error("Snapshot's transform arrays have a different layout than the scene's (added to or re-sorted since the snapshot).");
+	}
+	auto state = snapshot.transforms.begin();
+	for (auto &t : transforms) {
+		t.position = state->position;
+		t.rotation = state->rotation;
+		t.scale = state->scale;
+		t.parent = state->parent;
+		++state;
+	}
+	//(local_to_worlds are left for transform_arrays.update() to recompute)
+	transform_arrays.positions.assign(snapshot.transform_arrays.positions.begin(), snapshot.transform_arrays.positions.end());
+	transform_arrays.rotations.assign(snapshot.transform_arrays.rotations.begin(), snapshot.transform_arrays.rotations.end());
+	transform_arrays.scales.assign(snapshot.transform_arrays.scales.begin(), snapshot.transform_arrays.scales.end());
+	transform_arrays.parents.assign(snapshot.transform_arrays.parents.begin(), snapshot.transform_arrays.parents.end());
+}
+
+//-------------------------
+
+void Scene::Interpolator::save_previous(Scene const &scene) {
+	scene.snapshot(&previous);
+}
+
+void Scene::Interpolator::begin(Scene &scene, float alpha) {
+	assert(!blending && "Interpolator::begin() called twice without end()");
+	blended.clear();
+	blended_arrays.clear();
+	blending = true;
+
+	if (alpha >= 1.0f) return; //(already in current state)
+
+	//nothing to blend from if transforms have been added or removed since the previous state was saved:
+	// (e.g., before the first update)
+	if (previous.transforms.size() == scene.transforms.size()) {
+		auto prev = previous.transforms.begin();
+		for (auto &t : scene.transforms) {
+			if (prev->parent == t.parent
+			 && (prev->position != t.position || prev->rotation != t.rotation || prev->scale != t.scale)) {
+				blended.emplace_back(&t, State{t.position, t.rotation, t.scale});
+				t.position = glm::mix(prev->position, t.position, alpha);
+				t.rotation = glm::slerp(prev->rotation, t.rotation, alpha);
+				t.scale = glm::mix(prev->scale, t.scale, alpha);
+			}
+			++prev;
+		}
+	}
+
+	Snapshot::ArrayState const &prev_arrays = previous.transform_arrays;
+	TransformArrays &arrays = scene.transform_arrays;
+	if (prev_arrays.size() == arrays.size() && prev_arrays.index_to_id == arrays.index_to_id) {
+		for (uint32_t i = 0; i < arrays.size(); ++i) {
+			if (prev_arrays.parents[i] != arrays.parents[i]) continue;
+			if (prev_arrays.positions[i] == arrays.positions[i]
+			 && prev_arrays.rotations[i] == arrays.rotations[i]
+			 && prev_arrays.scales[i] == arrays.scales[i]) continue;
+			blended_arrays.emplace_back(i, State{arrays.positions[i], arrays.rotations[i], arrays.scales[i]});
+			arrays.positions[i] = glm::mix(prev_arrays.positions[i], arrays.positions[i], alpha);
+			arrays.rotations[i] = glm::slerp(prev_arrays.rotations[i], arrays.rotations[i], alpha);
+			arrays.scales[i] = glm::mix(prev_arrays.scales[i], arrays.scales[i], alpha);
+		}
+	}
+}
+
+void Scene::Interpolator::end(Scene &scene) {
+	assert(blending && "Interpolator::end() called without begin()");
+	for (auto const &[t, state] : blended) {
+		t->position = state.position;
+		t->rotation = state.rotation;
+		t->scale = state.scale;
+	}
+	TransformArrays &arrays = scene.transform_arrays;
+	for (auto const &[i, state] : blended_arrays) {
+		arrays.positions[i] = state.position;
+		arrays.rotations[i] = state.rotation;
+		arrays.scales[i] = state.scale;
 	}
+	blended.clear();
+	blended_arrays.clear();
+	blending = false;
 }
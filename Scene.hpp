@@ -11,10 +11,13 @@
  */
 
 #include "GL.hpp"
+#include "BVH.hpp"
+#include "ChunkFile.hpp"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 
+#include <limits>
 #include <list>
 #include <memory>
 #include <functional>
@@ -42,6 +45,32 @@ struct Scene {
 		// ..relative to the world:
 		glm::mat4x3 make_local_to_world() const;
 		glm::mat4x3 make_world_to_local() const;
+		// ..relative to the world, re-using the previous result if this transform and its parents haven't changed:
+		// (cheaper than the make_ versions when called every frame; the reference is good until the next call)
+		glm::mat4x3 const &get_local_to_world() const;
+		glm::mat4x3 const &get_world_to_local() const;
+
+		//internals:
+		//cached world matrices, along with the values they were computed from:
+		// (checked against current values by get_local_to_world(), so there is no need to mark transforms as changed)
+		struct Cache {
+			glm::vec3 position = glm::vec3(0.0f);
+			glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+			glm::vec3 scale = glm::vec3(1.0f);
+			Transform const *parent = nullptr;
+			uint32_t parent_version = 0; //parent's version when local_to_world was computed
+			uint32_t version = 0; //changes whenever local_to_world is recomputed (0 == never computed)
+			uint32_t pass = 0; //last caching pass in which this cache was checked (see Scene.cpp)
+			glm::mat4x3 local_to_world = glm::mat4x3(1.0f);
+			bool has_world_to_local = false; //world_to_local is computed on demand
+			glm::mat4x3 world_to_local = glm::mat4x3(1.0f);
+		};
+		mutable Cache cache;
+		void update_cache() const; //bring cache.local_to_world up to date
+
+		//unique number given to every transform when it is made (used by Scene::set() to look transforms up by index):
+		uint64_t const serial = next_serial();
+		static uint64_t next_serial();
 
 		//since hierarchy is tracked through pointers, copy-constructing a transform  is not advised:
 		Transform(Transform const &) = delete;
@@ -49,11 +78,72 @@ struct Scene {
 		Transform() = default;
 	};
 
+	//'TransformArrays' is an (optional) alternative to 'Transform' for scenes with very many transforms:
+	// transform data is kept in parallel arrays, sorted so that parents come before children,
+	// which makes updating world matrices a single linear pass and copying a scene a few memcpy's.
+	//Transforms in the arrays are referred to by handles, which stay valid when the arrays are re-sorted.
+	struct TransformArrays {
+		struct Handle {
+			Handle() : id(-1U) { } //(n.b. not a default member initializer, so that Handle() can be used as a default argument below)
+			explicit Handle(uint32_t id_) : id(id_) { }
+			uint32_t id; //(index into 'id_to_index')
+			explicit operator bool() const { return id != -1U; }
+		};
+
+		//add a transform (parent, if given, must already be in the arrays):
+		Handle add(std::string const &name,
+			glm::vec3 const &position = glm::vec3(0.0f),
+			glm::quat const &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+			glm::vec3 const &scale = glm::vec3(1.0f),
+			Handle parent = Handle());
+
+		//get a handle's current index in the arrays below:
+		// (indices change when set_parent() re-sorts the arrays; handles don't)
+		uint32_t index(Handle handle) const { assert(handle.id < id_to_index.size()); return id_to_index[handle.id]; }
+
+		//convenience accessors:
+		glm::vec3 &position(Handle handle) { return positions[index(handle)]; }
+		glm::quat &rotation(Handle handle) { return rotations[index(handle)]; }
+		glm::vec3 &scale(Handle handle) { return scales[index(handle)]; }
+		Handle parent(Handle handle) const;
+
+		//change the parent of a transform; re-sorts the arrays if needed to keep parents before children:
+		// throws if this would create a cycle
+		void set_parent(Handle handle, Handle parent);
+
+		//recompute local_to_world for every transform (called by Scene::draw()):
+		void update() const;
+		//world matrix as of the last update():
+		glm::mat4x3 const &local_to_world(Handle handle) const { return local_to_worlds[index(handle)]; }
+		//changes whenever update() changes local_to_world (like Transform::Cache::version):
+		uint32_t version(Handle handle) const { return versions[index(handle)]; }
+
+		size_t size() const { return positions.size(); }
+
+		//the arrays themselves (all the same length):
+		std::vector< glm::vec3 > positions;
+		std::vector< glm::quat > rotations;
+		std::vector< glm::vec3 > scales;
+		std::vector< uint32_t > parents; //index of parent, or -1U if none; always less than the transform's own index
+		std::vector< std::string > names;
+		mutable std::vector< glm::mat4x3 > local_to_worlds; //computed by update()
+		mutable std::vector< uint32_t > versions; //(0 == never computed)
+
+		//internals:
+		std::vector< uint32_t > id_to_index; //handle id -> current index
+		std::vector< uint32_t > index_to_id; //current index -> handle id
+		void sort(); //re-establish parent-before-child order
+	};
+
 	struct Drawable {
 		//a 'Drawable' attaches attribute data to a transform:
 		Drawable(Transform *transform_) : transform(transform_) { assert(transform); }
 		Transform * transform;
 
+		//..or to a transform in the scene's 'transform_arrays' (in which case 'transform' is nullptr):
+		Drawable(TransformArrays::Handle handle_) : transform(nullptr), handle(handle_) { assert(handle); }
+		TransformArrays::Handle handle;
+
 		//Contains all the data needed to run the OpenGL pipeline:
 		struct Pipeline {
 			GLuint program = 0; //shader program; passed to glUseProgram
@@ -65,6 +155,20 @@ struct Scene {
 			GLuint start = 0; //first vertex to draw; passed to glDrawArrays
 			GLuint count = 0; //number of vertices to draw; passed to glDrawArrays
 
+			//indexed drawing: if index_type is not GL_NONE, start and count give a range of indices
+			// in the element array buffer bound in 'vao', and glDrawElements is used instead:
+			GLenum index_type = GL_NONE; //type of indices (GL_UNSIGNED_SHORT or GL_UNSIGNED_INT), as in Mesh::index_type
+
+			//bounding box of the vertices drawn (in object space); used to skip drawables outside the view:
+			// (if min > max, as by default, the drawable is never culled)
+			glm::vec3 min = glm::vec3( std::numeric_limits< float >::infinity());
+			glm::vec3 max = glm::vec3(-std::numeric_limits< float >::infinity());
+
+			//quantized positions (as in Mesh::position_scale) are taken to object space by Scene::draw() as part of OBJECT_TO_CLIP and OBJECT_TO_LIGHT
+			// (and of per-instance OBJECT_TO_WORLD), but not of the normal matrices:
+			glm::vec3 position_scale = glm::vec3(1.0f);
+			glm::vec3 position_offset = glm::vec3(0.0f);
+
 			//uniforms:
 			GLuint OBJECT_TO_CLIP_mat4 = -1U; //uniform location for object to clip space matrix
 			GLuint OBJECT_TO_LIGHT_mat4x3 = -1U; //uniform location for object to light space (== world space) matrix
@@ -78,8 +182,42 @@ struct Scene {
 				GLuint texture = 0;
 				GLenum target = GL_TEXTURE_2D;
 			} textures[TextureCount];
+
+			//(optional) instanced version of this pipeline:
+			// when several drawables share a pipeline (program, vao, type, start, count, index_type, textures), have no set_uniforms,
+			// and have instanced.program set, Scene::draw() draws them all with one glDrawArraysInstanced call.
+			struct Instanced {
+				GLuint program = 0; //shader program that reads per-instance OBJECT_TO_WORLD (mat4x3) and NORMAL_TO_WORLD (mat3) attributes
+				GLuint vao = 0; //vertex array with the same per-vertex attributes as 'vao', plus per-instance attributes (see make_instance_vao())
+
+				//uniforms:
+				GLuint WORLD_TO_CLIP_mat4 = -1U; //uniform location for world to clip space matrix
+				GLuint WORLD_TO_LIGHT_mat4x3 = -1U; //uniform location for world to light space matrix
+				GLuint NORMAL_WORLD_TO_LIGHT_mat3 = -1U; //uniform location for world to light space matrix for normals
+			} instanced;
 		} pipeline;
+
+		//internals (maintained by Scene::update_bvh()):
+		mutable uint32_t bvh_leaf = -1U; //leaf in Scene::bvh holding this drawable's world bounds
+		mutable uint32_t order = 0; //position in Scene::drawables
+		mutable glm::vec3 world_min = glm::vec3(0.0f); //world-space bounds
+		mutable glm::vec3 world_max = glm::vec3(0.0f);
+		//what world_min/max were computed from (so they are only recomputed when these change):
+		mutable uint32_t world_version = 0; //version of the transform's local_to_world (0 == never computed)
+		mutable glm::vec3 world_from_min = glm::vec3(0.0f); //pipeline.min/max
+		mutable glm::vec3 world_from_max = glm::vec3(0.0f);
+	};
+
+	//Per-instance data streamed to instanced programs by Scene::draw():
+	struct InstanceData {
+		glm::mat4x3 object_to_world;
+		glm::mat3 normal_to_world;
 	};
+	static_assert(sizeof(InstanceData) == 4*3*4 + 3*3*4, "InstanceData is packed.");
+
+	//make a vertex array object with per-instance attributes (from InstanceData) bound for 'program':
+	// (use with MeshBuffer::make_vao_for_program(program, vao) to add the per-vertex attributes)
+	static GLuint make_instance_vao(GLuint program);
 
 	struct Camera {
 		//a 'Camera' attaches camera data to a transform:
@@ -118,6 +256,7 @@ struct Scene {
 
 	//Scenes, of course, may have many of the above objects:
 	std::list< Transform > transforms;
+	TransformArrays transform_arrays; //(optional; see above)
 	std::list< Drawable > drawables;
 	std::list< Camera > cameras;
 	std::list< Light > lights;
@@ -127,6 +266,36 @@ struct Scene {
 
 	//..sometimes, you want to draw with a custom projection matrix and/or light space:
 	void draw(glm::mat4 const &world_to_clip, glm::mat4x3 const &world_to_light = glm::mat4x3(1.0f)) const;
+	//NOTE: draw() skips drawables whose bounds (pipeline.min/max) are outside the view frustum (using the bvh; see below),
+	// sorts drawables by program, vertex array, and textures (keeping 'drawables' order otherwise),
+	// and only sends OpenGL the state that changes between drawables.
+
+	//Statistics about the most recent draw() call:
+	struct DrawStats {
+		uint32_t draws = 0; //number of draw calls made
+		uint32_t program_changes = 0; //number of glUseProgram calls
+		uint32_t vao_changes = 0; //number of glBindVertexArray calls
+		uint32_t texture_changes = 0; //number of glBindTexture calls
+		int32_t elided_state_changes = 0; //number of the above calls avoided versus binding (and un-binding) everything per-drawable
+		uint32_t instanced_draws = 0; //number of draw calls (of the above) that were instanced
+		uint32_t instances = 0; //number of drawables drawn by instanced draw calls
+		uint32_t triangles = 0; //number of triangles drawn (including all instances)
+		uint32_t visible = 0; //number of drawables that were (at least partly) inside the view frustum
+		uint32_t culled = 0; //number of drawables skipped because they were outside the view frustum
+	};
+	mutable DrawStats draw_stats;
+
+	//Spatial queries against the world-space bounds of drawables (those with pipeline.min/max set):
+	// these use a bounding volume hierarchy that is brought up to date by update_bvh() (which draw() also calls),
+	// so call update_bvh() after moving things and before querying.
+	void update_bvh() const;
+	//drawables whose bounds overlap the box [min,max]:
+	void query_box(glm::vec3 const &min, glm::vec3 const &max, std::vector< Drawable const * > *out) const;
+	//drawables whose bounds are (maybe) inside the view frustum of world_to_clip:
+	void query_frustum(glm::mat4 const &world_to_clip, std::vector< Drawable const * > *out) const;
+	//the drawable whose bounds are first hit by the ray origin + t * direction, for t in [0,max_t] (or nullptr if none):
+	Drawable const *ray_cast(glm::vec3 const &origin, glm::vec3 const &direction,
+		float max_t = std::numeric_limits< float >::infinity(), float *hit_t = nullptr) const;
 
 	//add transforms/objects/cameras from a scene file to this scene:
 	// the 'on_drawable' callback gives your code a chance to look up mesh data and make Drawables:
@@ -137,7 +306,8 @@ struct Scene {
 
 	//this function is called to read extra chunks from the scene file after the main chunks are read:
 	// this is useful if you, e.g., subclassing scene to represent a game level/area
-	virtual void load_extra(std::istream &from, std::vector< char > const &str0, std::vector< Transform * > const &xfh0) { }
+	// (use from.view< T >(magic) or from.find(magic) to get at any chunk in the file)
+	virtual void load_extra(ChunkFile &from, ChunkFile::Span< char > const &str0, std::vector< Transform * > const &xfh0) { }
 
 	//empty scene:
 	Scene() = default;
@@ -150,4 +320,66 @@ struct Scene {
 	Scene &operator=(Scene const &); //...as scene = scene
 	//... as a set() function that optionally returns the transform->transform mapping:
 	void set(Scene const &, std::unordered_map< Transform const *, Transform * > *transform_map = nullptr);
+
+	//internals:
+	mutable std::vector< Drawable const * > draw_queue; //used by draw() (kept around to avoid allocating every frame)
+	mutable std::vector< InstanceData > instance_data; //used by draw() to gather instanced drawables
+	mutable BVH bvh; //world bounds of drawables, as of the last update_bvh()
+	mutable std::vector< Drawable const * > unbounded_drawables; //drawables without bounds (so not in bvh), as of the last update_bvh()
+	mutable std::vector< bool > bvh_keep; //used by update_bvh() to find leaves of removed drawables (kept around to avoid allocating every frame)
+
+	//Snapshots record the state (position, rotation, scale, parent) of every transform in a scene,
+	// so that the scene can quickly be put back the way it was (e.g., when restarting a level):
+	struct Snapshot {
+		struct TransformState {
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+			Transform *parent;
+		};
+		std::vector< TransformState > transforms; //in the same order as Scene::transforms
+		//state of Scene::transform_arrays (just the transform state, not names or cached matrices):
+		struct ArrayState {
+			std::vector< glm::vec3 > positions;
+			std::vector< glm::quat > rotations;
+			std::vector< glm::vec3 > scales;
+			std::vector< uint32_t > parents;
+			std::vector< uint32_t > index_to_id; //(to check that the arrays haven't been added to or re-sorted since)
+			size_t size() const { return positions.size(); }
+		} transform_arrays;
+	};
+	Snapshot snapshot() const;
+	void snapshot(Snapshot *into) const; //(same, but re-uses into's storage)
+
+	//restore transform state from a snapshot of this scene:
+	// (only transforms are restored -- drawables, cameras, and lights are left alone)
+	// throws if transforms have been added or removed (or transform_arrays re-sorted) since the snapshot was taken
+	void restore(Snapshot const &);
+
+	//An Interpolator lets a mode with a fixed timestep (see Mode::tick) draw its scene part-way between updates:
+	// call save_previous() at the start of every update(), and wrap drawing in begin(alpha) / end().
+	struct Interpolator {
+		//remember the current transform state as the previous state:
+		// (copies just position/rotation/scale/parent -- see Snapshot -- into storage that is re-used every tick)
+		void save_previous(Scene const &scene);
+		// (also call this after teleporting things, e.g. when restarting a level, so they don't visibly slide there)
+		//move transforms 'alpha' of the way from their previous state to their current state:
+		// (position and scale are blended linearly, rotation by slerp; transforms whose parent changed are left alone)
+		// only transforms whose state changed since save_previous() are touched
+		void begin(Scene &scene, float alpha);
+		//put transforms moved by begin() back in their current state:
+		void end(Scene &scene);
+
+		//internals:
+		Snapshot previous; //(only read by begin())
+		struct State {
+			glm::vec3 position;
+			glm::quat rotation;
+			glm::vec3 scale;
+		};
+		//transforms moved by begin(), along with their current state (to be put back by end()):
+		std::vector< std::pair< Transform *, State > > blended;
+		std::vector< std::pair< uint32_t, State > > blended_arrays; //(by index in transform_arrays)
+		bool blending = false; //between begin() and end()?
+	};
 };
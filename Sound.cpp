@@ -1,27 +1,393 @@
 #include "Sound.hpp"
 #include "load_wav.hpp"
 #include "load_opus.hpp"
+#include "mix_mono_to_stereo.hpp"
+#include "Profiler.hpp"
 
 #include <SDL.h>
 
-#include <list>
+#include <array>
+#include <atomic>
 #include <cassert>
 #include <exception>
+#include <fstream>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <thread>
+
+//Stream decoders keep a ring buffer of decoded audio a few seconds ahead of playback:
+// the decoding thread writes at 'write_position', mix_audio reads at 'read_position'.
+// (positions count samples since the stream was opened and never wrap; index the ring with '& (Capacity - 1)')
+struct Sound::Stream::Decoder {
+	static constexpr uint32_t const Capacity = 1 << 17; //~2.7 seconds at 48kHz
+	static constexpr uint32_t const MinWrite = 4096; //don't wake up to decode less than this
+
+	Decoder(std::string const &filename) : reader(filename), ring(Capacity, 0.0f) {
+		thread = std::thread(&Decoder::run, this);
+	}
+	~Decoder() {
+		quit.store(true, std::memory_order_relaxed);
+		thread.join();
+	}
+
+	void run();
+
+	OpusReader reader; //(only used by the decoding thread after construction)
+	std::vector< float > ring;
+
+	std::atomic< uint64_t > write_position{0}; //written by decoding thread
+	std::atomic< uint64_t > read_position{0}; //written by mix_audio
+	std::atomic< uint64_t > flush_position{0}; //data before this is stale (written by decoding thread after a seek)
+	std::atomic< int64_t > seek_request{-1}; //sample to seek to, or -1 if none (written by game thread, cleared by decoding thread)
+	std::atomic< bool > looping{false}; //go back to the start at end of file? (written by game thread)
+	std::atomic< bool > finished{false}; //has decoding reached the end of the file? (written by decoding thread)
+	std::atomic< bool > quit{false};
+
+	std::thread thread;
+};
+
+void Sound::Stream::Decoder::run() {
+	Profiler::set_thread_name("stream \"" + reader.filename + "\"");
+	try {
+		while (!quit.load(std::memory_order_relaxed)) {
+			int64_t seek_to = seek_request.load(std::memory_order_acquire);
+			if (seek_to >= 0) {
+				reader.seek(reader.length ? std::min(uint64_t(seek_to), reader.length) : uint64_t(seek_to));
+				//everything decoded so far is now stale:
+				flush_position.store(write_position.load(std::memory_order_relaxed), std::memory_order_release);
+				finished.store(false, std::memory_order_release);
+				//(if game thread already asked for another seek, leave that request for next time around)
+				seek_request.compare_exchange_strong(seek_to, -1, std::memory_order_acq_rel);
+				continue;
+			}
+
+			if (finished.load(std::memory_order_relaxed) && looping.load(std::memory_order_relaxed)) {
+				//stream was started looping after it had played to the end:
+				reader.seek(0);
+				finished.store(false, std::memory_order_release);
+			}
+
+			uint64_t write = write_position.load(std::memory_order_relaxed);
+			uint64_t space = Capacity - (write - read_position.load(std::memory_order_acquire));
+			if (space < MinWrite || finished.load(std::memory_order_relaxed)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+				continue;
+			}
+
+			//decode straight into the ring, up to the wrap point:
+			PROFILE_ZONE("Stream::decode");
+			uint32_t offset = uint32_t(write & (Capacity - 1));
+			uint32_t count = uint32_t(std::min< uint64_t >(space, Capacity - offset));
+			uint32_t got = reader.read(&ring[offset], count);
+			if (got > 0) {
+				write_position.store(write + got, std::memory_order_release);
+			} else if (looping.load(std::memory_order_relaxed)) {
+				reader.seek(0);
+			} else {
+				finished.store(true, std::memory_order_release);
+			}
+		}
+	} catch (std::exception &e) {
+		std::cerr << "WARNING: stopped streaming \"" << reader.filename << "\" because of an error:\n" << e.what() << std::endl;
+		finished.store(true, std::memory_order_release);
+	}
+}
 
 //local (to this file) data used by the audio system:
 namespace {
 
 	//handy constants:
-	constexpr uint32_t const AUDIO_RATE = 48000; //sampling rate
-	constexpr uint32_t const MIX_SAMPLES = 1024; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
+	constexpr uint32_t const AUDIO_RATE = Sound::AudioRate; //sampling rate
+	constexpr uint32_t const MIX_SAMPLES = Sound::BlockSize; //number of samples to mix per call of mix_audio callback; n.b. SDL requires this to be a power of two
 
 	//The audio device:
 	SDL_AudioDeviceID device = 0;
 
-	//list of all currently playing samples:
-	std::list< std::shared_ptr< Sound::PlayingSample > > playing_samples;
+	//Voices book-keep samples that are currently playing:
+	// (voice state is only touched by the audio thread -- the game thread talks to it through 'commands', below)
+	struct Voice {
+		std::vector< float > const *data = nullptr; //sample data being played (nullptr if voice is free or playing a stream)
+		Sound::Stream::Decoder *stream = nullptr; //stream being played (nullptr if voice is free or playing a sample)
+		uint32_t i = 0; //next data value to read
+		bool loop = false; //should playback loop after data runs out?
+		bool stopping = false; //is playing stopping?
+		uint32_t generation = 0; //generation of the handle that started this voice
+
+		Sound::Ramp< float > volume = Sound::Ramp< float >(1.0f);
+
+		//2D playback panning control: ('NaN' if sound played in 3D mode)
+		Sound::Ramp< float > pan = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		//3D playback panning control: ('NaN' if sound played in 2D mode)
+		Sound::Ramp< glm::vec3 > position = Sound::Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
+		Sound::Ramp< float > half_volume_radius = Sound::Ramp< float >(std::numeric_limits< float >::quiet_NaN());
+
+		bool in_use() const { return data != nullptr || stream != nullptr; }
+	};
+
+	//pool of all voices; allocated once by Sound::init() and never resized:
+	std::vector< Voice > voices;
+
+	//mixer statistics (written by mix_audio, read by get_mix_stats):
+	std::atomic< uint32_t > stats_playing_voices{0};
+	std::atomic< uint32_t > stats_mix_ns{0};
+	std::atomic< uint32_t > stats_max_mix_ns{0};
+
+	//indices of voices that are currently playing (mix_audio mixes these):
+	// (reserved to MaxPlayingSamples in Sound::init(), so push_back never allocates)
+	std::vector< uint32_t > playing_voices;
+
+	//Single-producer, single-consumer lock-free ring buffer:
+	// the producer thread calls push(), the consumer thread calls pop().
+	template< typename T, uint32_t Capacity >
+	struct SPSCRing {
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity should be a power of two.");
+
+		//returns false if ring is full:
+		bool push(T const &value) {
+			uint32_t tail_ = tail.load(std::memory_order_relaxed);
+			if (tail_ - head.load(std::memory_order_acquire) == Capacity) return false;
+			slots[tail_ & (Capacity - 1)] = value;
+			tail.store(tail_ + 1, std::memory_order_release);
+			return true;
+		}
+		//returns false if ring is empty:
+		bool pop(T *value) {
+			uint32_t head_ = head.load(std::memory_order_relaxed);
+			if (head_ == tail.load(std::memory_order_acquire)) return false;
+			*value = slots[head_ & (Capacity - 1)];
+			head.store(head_ + 1, std::memory_order_release);
+			return true;
+		}
+
+		std::array< T, Capacity > slots;
+		std::atomic< uint32_t > head{0}; //next slot to pop (written by consumer)
+		std::atomic< uint32_t > tail{0}; //next slot to push (written by producer)
+	};
+
+	//Commands carry parameter changes from the game thread to mix_audio:
+	struct Command {
+		enum Type : uint8_t {
+			Play, //start voice 'index' playing 'data' or 'stream'
+			SetVolume, //voice volume <- 'value'
+			SetPan, //voice pan <- 'value'
+			SetPosition, //voice position <- 'position'
+			SetHalfVolumeRadius, //voice half_volume_radius <- 'value'
+			Stop, //fade voice out
+			StopAll, //fade all voices out
+			SetGlobalVolume, //Sound::volume <- 'value'
+			SetListener, //Sound::listener <- 'position', 'right'
+		} type = Play;
+		bool loop = false; //(Play)
+		uint32_t index = -1U; //voice index (per-voice commands)
+		uint32_t generation = 0; //handle generation (per-voice commands)
+		float ramp = 0.0f;
+		float value = 0.0f;
+		float pan = 0.0f; //(Play)
+		float half_volume_radius = 0.0f; //(Play)
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 right = glm::vec3(0.0f); //(SetListener)
+		std::vector< float > const *data = nullptr; //(Play)
+		Sound::Stream::Decoder *stream = nullptr; //(Play)
+	};
+
+	//game thread -> audio thread: (drained at the start of every mix_audio call)
+	constexpr uint32_t const COMMAND_CAPACITY = 8192;
+	SPSCRing< Command, COMMAND_CAPACITY > commands;
+
+	//audio thread -> game thread: indices of voices that have finished playing
+	// (a voice is only ever released once per play, so this can never fill up)
+	SPSCRing< uint32_t, Sound::MaxPlayingSamples > released_voices;
+	static_assert((Sound::MaxPlayingSamples & (Sound::MaxPlayingSamples - 1)) == 0, "released_voices needs a power-of-two capacity.");
+
+	//game-thread book-keeping for the voice pool:
+	// (both reserved/sized in Sound::init(), so never allocate afterward)
+	std::vector< uint32_t > free_voices; //indices of voices available for new samples
+	std::vector< uint32_t > voice_generations; //current handle generation of each voice
+
+	//(game thread) move voices that the audio thread has finished with back to the free list:
+	void reclaim_voices() {
+		uint32_t index;
+		while (released_voices.pop(&index)) {
+			voice_generations[index] += 1; //invalidate any outstanding handles
+			free_voices.push_back(index);
+		}
+	}
+
+	//(game thread) is 'handle' the current handle for its voice?
+	bool is_current(Sound::PlayingSample const &handle) {
+		return handle.index < voice_generations.size() && voice_generations[handle.index] == handle.generation;
+	}
+
+	//(audio thread) look up the voice a command refers to:
+	// returns nullptr if the voice has already finished
+	Voice *lookup(Command const &command) {
+		if (command.index >= voices.size()) return nullptr;
+		Voice &voice = voices[command.index];
+		if (!voice.in_use() || voice.generation != command.generation) return nullptr;
+		return &voice;
+	}
+
+	//(audio thread) apply all pending commands:
+	void apply_commands() {
+		Command command;
+		while (commands.pop(&command)) {
+			if (command.type == Command::Play) {
+				Voice &voice = voices[command.index];
+				assert(!voice.in_use()); //game thread only reuses voices after they are released
+
+				voice.data = command.data;
+				voice.stream = command.stream;
+				voice.i = 0;
+				voice.loop = command.loop;
+				voice.stopping = false;
+				voice.generation = command.generation;
+				voice.volume = Sound::Ramp< float >(command.value);
+				voice.pan = Sound::Ramp< float >(command.pan);
+				voice.position = Sound::Ramp< glm::vec3 >(command.position);
+				voice.half_volume_radius = Sound::Ramp< float >(command.half_volume_radius);
+
+				playing_voices.push_back(command.index);
+			} else if (command.type == Command::SetVolume) {
+				Voice *voice = lookup(command);
+				if (voice && !voice->stopping) {
+					voice->volume.set(command.value, command.ramp);
+				}
+			} else if (command.type == Command::SetPan) {
+				Voice *voice = lookup(command);
+				if (voice && voice->pan.value == voice->pan.value) { //ignore if not in '2D' mode
+					voice->pan.set(command.value, command.ramp);
+				}
+			} else if (command.type == Command::SetPosition) {
+				Voice *voice = lookup(command);
+				if (voice && !(voice->pan.value == voice->pan.value)) { //ignore if not in '3D' mode
+					voice->position.set(command.position, command.ramp);
+				}
+			} else if (command.type == Command::SetHalfVolumeRadius) {
+				Voice *voice = lookup(command);
+				if (voice && !(voice->pan.value == voice->pan.value)) { //ignore if not in '3D' mode
+					voice->half_volume_radius.set(command.value, command.ramp);
+				}
+			} else if (command.type == Command::Stop || command.type == Command::StopAll) {
+				auto stop = [&command](Voice &voice) {
+					if (!voice.stopping) {
+						voice.stopping = true;
+						voice.volume.target = 0.0f;
+						voice.volume.ramp = command.ramp;
+					} else {
+						voice.volume.ramp = std::min(voice.volume.ramp, command.ramp);
+					}
+				};
+				if (command.type == Command::Stop) {
+					Voice *voice = lookup(command);
+					if (voice) stop(*voice);
+				} else {
+					for (uint32_t index : playing_voices) {
+						stop(voices[index]);
+					}
+				}
+			} else if (command.type == Command::SetGlobalVolume) {
+				Sound::volume.set(command.value, command.ramp);
+			} else if (command.type == Command::SetListener) {
+				Sound::listener.position.set(command.position, command.ramp);
+				Sound::listener.right.set(command.right, command.ramp);
+			} else {
+				assert(0 && "unknown command type");
+			}
+		}
+	}
+
+	//(game thread) send a command to the audio thread:
+	void send(Command const &command) {
+		if (!commands.push(command)) {
+			//ring is full -- either the game sent an enormous number of commands this frame
+			// or there is no audio callback draining it. Take the lock (so the callback can't
+			// run) and drain the ring from this thread instead:
+			Sound::lock();
+			apply_commands();
+			Sound::unlock();
+			bool pushed = commands.push(command);
+			assert(pushed);
+			(void)pushed;
+		}
+	}
+
+	//(audio thread) stop voice playing_voices[pv] and hand it back to the game thread for reuse:
+	// (removes entry 'pv' from playing_voices by swapping in the last entry)
+	void release_voice(uint32_t pv) {
+		Voice &voice = voices[playing_voices[pv]];
+		voice.data = nullptr;
+		voice.stream = nullptr;
+		bool released = released_voices.push(playing_voices[pv]);
+		assert(released);
+		(void)released;
+		playing_voices[pv] = playing_voices.back();
+		playing_voices.pop_back();
+	}
+
+	//grab a free voice and start it playing sample data or a stream:
+	// (pan should be NaN for 3D samples)
+	Sound::PlayingSample start_voice(std::vector< float > const *data, Sound::Stream::Decoder *stream, float volume, float pan, glm::vec3 const &position, float half_volume_radius, bool loop) {
+		assert((data != nullptr) != (stream != nullptr)); //should play exactly one of these
+		if (data && data->empty()) return Sound::PlayingSample(); //nothing to play
+
+		reclaim_voices();
+
+		if (free_voices.empty()) {
+			static bool warned = false;
+			if (!warned) {
+				std::cerr << "WARNING: all " << Sound::MaxPlayingSamples << " voices are busy; some samples will not be played." << std::endl;
+				warned = true;
+			}
+			return Sound::PlayingSample();
+		}
+
+		Sound::PlayingSample handle;
+		handle.index = free_voices.back();
+		free_voices.pop_back();
+		handle.generation = voice_generations[handle.index];
+
+		Command command;
+		command.type = Command::Play;
+		command.index = handle.index;
+		command.generation = handle.generation;
+		command.data = data;
+		command.stream = stream;
+		command.loop = loop;
+		command.value = volume;
+		command.pan = pan;
+		command.position = position;
+		command.half_volume_radius = half_volume_radius;
+		send(command);
+
+		return handle;
+	}
+
+	//allocate the voice pool up front so that playing a sample never allocates:
+	void allocate_voices() {
+		if (!voices.empty()) return;
+		voices.resize(Sound::MaxPlayingSamples);
+		playing_voices.reserve(Sound::MaxPlayingSamples);
+		voice_generations.assign(Sound::MaxPlayingSamples, 0);
+		free_voices.reserve(Sound::MaxPlayingSamples);
+		for (uint32_t i = Sound::MaxPlayingSamples; i > 0; --i) {
+			free_voices.push_back(i - 1); //(pushed in reverse so that voice 0 is handed out first)
+		}
+	}
+
+	//helper for the per-voice commands sent by PlayingSample handles:
+	void send_voice_command(Sound::PlayingSample const &handle, Command::Type type, float ramp, float value = 0.0f, glm::vec3 const &position = glm::vec3(0.0f)) {
+		if (!is_current(handle)) return; //voice has already finished
+		Command command;
+		command.type = type;
+		command.index = handle.index;
+		command.generation = handle.generation;
+		command.ramp = ramp;
+		command.value = value;
+		command.position = position;
+		send(command);
+	}
 
 }
 
@@ -51,9 +417,34 @@ Sound::Sample::Sample(std::string const &filename) {
 Sound::Sample::Sample(std::vector< float > const &data_) : data(data_) {
 }
 
+Sound::Stream::Stream(std::string const &filename) : decoder(new Decoder(filename)) {
+}
+
+Sound::Stream::~Stream() {
+	//make sure the audio thread is done with the decoder before stopping it:
+	lock();
+	apply_commands(); //(in case this stream was started since the last mix_audio call)
+	for (uint32_t pv = 0; pv < playing_voices.size(); /* later */) {
+		if (voices[playing_voices[pv]].stream == decoder.get()) {
+			release_voice(pv);
+		} else {
+			++pv;
+		}
+	}
+	unlock();
+
+	decoder.reset();
+}
+
+void Sound::Stream::seek(float time) {
+	decoder->seek_request.store(int64_t(std::max(0.0f, time) * AUDIO_RATE), std::memory_order_release);
+}
+
 
 
 void Sound::init() {
+	allocate_voices();
+
 	if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0) {
 		std::cerr << "Failed to initialize SDL audio subsytem:\n" << SDL_GetError() << std::endl;
 		std::cerr << "  (Will continue without audio.)\n" << std::endl;
@@ -68,6 +459,8 @@ void Sound::init() {
 	want.channels = 2;
 	want.samples = MIX_SAMPLES;
 	want.callback = mix_audio;
+	//(the audio thread's profiler track is made here, since mix_audio must not allocate)
+	want.userdata = Profiler::make_track("audio");
 
 	device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
 	if (device == 0) {
@@ -91,6 +484,58 @@ void Sound::shutdown() {
 }
 
 
+void Sound::init_headless() {
+	allocate_voices();
+	std::cout << "Audio mixer initialized without an output device." << std::endl;
+}
+
+void Sound::render(float *buffer, uint32_t blocks) {
+	assert(buffer || blocks == 0);
+	for (uint32_t b = 0; b < blocks; ++b) {
+		//(lock in case there is also a real device -- mix_audio must only run on one thread at a time)
+		lock();
+		mix_audio(nullptr, reinterpret_cast< Uint8 * >(buffer + 2 * BlockSize * b), int(2 * BlockSize * sizeof(float)));
+		unlock();
+	}
+}
+
+void Sound::render_to_wav(std::string const &filename, uint32_t blocks) {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) throw std::runtime_error("Failed to open '" + filename + "' for writing.");
+
+	//RIFF/WAVE header for 32-bit float stereo data:
+	// (see, e.g., http://soundfile.sapp.org/doc/WaveFormat/ ; format 3 is IEEE float)
+	struct WavHeader {
+		char riff[4] = {'R','I','F','F'};
+		uint32_t riff_size = 0;
+		char wave[4] = {'W','A','V','E'};
+		char fmt[4] = {'f','m','t',' '};
+		uint32_t fmt_size = 16;
+		uint16_t format = 3;
+		uint16_t channels = 2;
+		uint32_t rate = AudioRate;
+		uint32_t byte_rate = AudioRate * 2 * sizeof(float);
+		uint16_t block_align = 2 * sizeof(float);
+		uint16_t bits_per_sample = 32;
+		char data[4] = {'d','a','t','a'};
+		uint32_t data_size = 0;
+	};
+	static_assert(sizeof(WavHeader) == 44, "WavHeader is packed.");
+
+	WavHeader header;
+	header.data_size = uint32_t(blocks * BlockSize * 2 * sizeof(float));
+	header.riff_size = uint32_t(sizeof(WavHeader) - 8 + header.data_size);
+	out.write(reinterpret_cast< char const * >(&header), sizeof(header));
+
+	std::vector< float > block(2 * BlockSize);
+	for (uint32_t b = 0; b < blocks; ++b) {
+		render(block.data(), 1);
+		out.write(reinterpret_cast< char const * >(block.data()), block.size() * sizeof(float));
+	}
+
+	if (!out) throw std::runtime_error("Failed to write audio to '" + filename + "'.");
+}
+
 void Sound::lock() {
 	if (device) SDL_LockAudioDevice(device);
 }
@@ -99,110 +544,107 @@ void Sound::unlock() {
 	if (device) SDL_UnlockAudioDevice(device);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::MixStats Sound::get_mix_stats() {
+	MixStats stats;
+	stats.playing_voices = stats_playing_voices.load(std::memory_order_relaxed);
+	stats.mix_ms = float(stats_mix_ns.load(std::memory_order_relaxed)) * 1e-6f;
+	stats.max_mix_ms = float(stats_max_mix_ns.exchange(0, std::memory_order_relaxed)) * 1e-6f;
+	return stats;
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, false);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play(Sample const &sample, float play_volume, float pan) {
+	return start_voice(&sample.data, nullptr, play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false);
 }
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop(Sample const &sample, float play_volume, float pan) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, pan, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+Sound::PlayingSample Sound::play_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_voice(&sample.data, nullptr, play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, false);
 }
 
+Sound::PlayingSample Sound::loop(Sample const &sample, float play_volume, float pan) {
+	return start_voice(&sample.data, nullptr, play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), true);
+}
 
+Sound::PlayingSample Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
+	return start_voice(&sample.data, nullptr, play_volume, std::numeric_limits< float >::quiet_NaN(), position, half_volume_radius, true);
+}
 
-std::shared_ptr< Sound::PlayingSample > Sound::loop_3D(Sample const &sample, float play_volume, glm::vec3 const &position, float half_volume_radius) {
-	std::shared_ptr< Sound::PlayingSample > playing_sample = std::make_shared< Sound::PlayingSample >(sample, play_volume, position, half_volume_radius, true);
-	lock();
-	playing_samples.emplace_back(playing_sample);
-	unlock();
-	return playing_sample;
+//helper for play/loop on streams:
+static Sound::PlayingSample start_stream(Sound::Stream &stream, float play_volume, float pan, bool loop) {
+	if (!stream.playing.stopped()) {
+		std::cerr << "WARNING: stream \"" << stream.decoder->reader.filename << "\" is already playing; not starting it again." << std::endl;
+		return Sound::PlayingSample();
+	}
+	stream.decoder->looping.store(loop, std::memory_order_relaxed);
+	//(streams loop by going back to the start of the file when decoding, so the voice itself never loops)
+	stream.playing = start_voice(nullptr, stream.decoder.get(), play_volume, pan, glm::vec3(std::numeric_limits< float >::quiet_NaN()), std::numeric_limits< float >::quiet_NaN(), false);
+	return stream.playing;
+}
+
+Sound::PlayingSample Sound::play(Stream &stream, float play_volume, float pan) {
+	return start_stream(stream, play_volume, pan, false);
+}
+
+Sound::PlayingSample Sound::loop(Stream &stream, float play_volume, float pan) {
+	return start_stream(stream, play_volume, pan, true);
 }
 
 
 void Sound::stop_all_samples() {
-	lock();
-	for (auto &s : playing_samples) {
-		s->stop();
-	}
-	unlock();
+	Command command;
+	command.type = Command::StopAll;
+	command.ramp = 1.0f / 60.0f;
+	send(command);
 }
 
 void Sound::set_volume(float new_volume, float ramp) {
-	lock();
-	volume.set(new_volume, ramp);
-	unlock();
+	Command command;
+	command.type = Command::SetGlobalVolume;
+	command.value = new_volume;
+	command.ramp = ramp;
+	send(command);
 }
 
 //------------------
 
 void Sound::PlayingSample::set_volume(float new_volume, float ramp) {
-	Sound::lock();
-	if (!stopping) {
-		volume.set(new_volume, ramp);
-	}
-	Sound::unlock();
+	send_voice_command(*this, Command::SetVolume, ramp, new_volume);
 }
 
 void Sound::PlayingSample::set_pan(float new_pan, float ramp) {
-	if (!(pan.value == pan.value)) return; //ignore if not in '2D' mode
-	Sound::lock();
-	pan.set(new_pan, ramp);
-	Sound::unlock();
+	send_voice_command(*this, Command::SetPan, ramp, new_pan);
 }
 
 void Sound::PlayingSample::set_position(glm::vec3 const &new_position, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	position.set(new_position, ramp);
-	Sound::unlock();
+	send_voice_command(*this, Command::SetPosition, ramp, 0.0f, new_position);
 }
 
 void Sound::PlayingSample::set_half_volume_radius(float new_radius, float ramp) {
-	if (pan.value == pan.value) return; //ignore if not in '3D' mode
-	Sound::lock();
-	half_volume_radius.set(new_radius, ramp);
-	Sound::unlock();
+	send_voice_command(*this, Command::SetHalfVolumeRadius, ramp, new_radius);
 }
 
 void Sound::PlayingSample::stop(float ramp) {
-	Sound::lock();
-	if (!(stopping || stopped)) {
-		stopping = true;
-		volume.target = 0.0f;
-		volume.ramp = ramp;
-	} else {
-		volume.ramp = std::min(volume.ramp, ramp);
-	}
-	Sound::unlock();
+	send_voice_command(*this, Command::Stop, ramp);
+}
+
+bool Sound::PlayingSample::stopped() const {
+	reclaim_voices();
+	return !is_current(*this);
 }
 
 //------------------
 
 void Sound::Listener::set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp) {
-	Sound::lock();
-	position.set(new_position, ramp);
+	Command command;
+	command.type = Command::SetListener;
+	command.position = new_position;
 	//some extra code to make sure right is always a unit vector:
 	if (new_right == glm::vec3(0.0f)) {
-		right.set(glm::vec3(1.0f, 0.0f, 0.0f), ramp);
+		command.right = glm::vec3(1.0f, 0.0f, 0.0f);
 	} else {
-		right.set(glm::normalize(new_right), ramp);
+		command.right = glm::normalize(new_right);
 	}
-	Sound::unlock();
+	command.ramp = ramp;
+	send(command);
 }
 
 //------------------------ internals --------------------------------
@@ -311,8 +753,11 @@ void step_direction_ramp(Sound::Ramp< glm::vec3 > &ramp) {
 
 
 //The audio callback -- invoked by SDL when it needs more sound to play:
-void mix_audio(void *, Uint8 *buffer_, int len) {
+void mix_audio(void *profiler_track, Uint8 *buffer_, int len) {
 	assert(buffer_); //should always have some audio buffer
+	Profiler::use_track(reinterpret_cast< Profiler::Track * >(profiler_track)); //(nullptr when called by init_headless)
+	PROFILE_ZONE("mix_audio");
+	auto mix_start = std::chrono::steady_clock::now();
 
 	struct LR {
 		float l;
@@ -322,6 +767,9 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	assert(len == MIX_SAMPLES * sizeof(LR)); //should always have the expected number of samples
 	LR *buffer = reinterpret_cast< LR * >(buffer_);
 
+	//pick up any changes sent from the game thread:
+	apply_commands();
+
 	//zero the output buffer:
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		buffer[s].l = 0.0f;
@@ -342,8 +790,8 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	glm::vec3 end_right =  Sound::listener.right.value;
 
 	//add audio from each playing sample into the buffer:
-	for (auto si = playing_samples.begin(); si != playing_samples.end(); /* later */) {
-		Sound::PlayingSample &playing_sample = **si; //much more convenient than writing ** everywhere.
+	for (uint32_t pv = 0; pv < playing_voices.size(); /* later */) {
+		Voice &playing_sample = voices[playing_voices[pv]];
 
 		//Figure out sample panning/volume at start...
 		LR start_pan;
@@ -386,42 +834,69 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 		end_pan.r *= end_volume * playing_sample.volume.value;
 
 		//figure out a step to add at each sample so that pan will move smoothly from start to end:
-		LR pan = start_pan;
 		LR pan_step;
 		pan_step.l = (end_pan.l - start_pan.l) / MIX_SAMPLES;
 		pan_step.r = (end_pan.r - start_pan.r) / MIX_SAMPLES;
 
-		assert(playing_sample.i < playing_sample.data.size());
-
-		for (uint32_t i = 0; i < MIX_SAMPLES; ++i) {
-			//mix one sample based on current pan values:
-			buffer[i].l += pan.l * playing_sample.data[playing_sample.i];
-			buffer[i].r += pan.r * playing_sample.data[playing_sample.i];
+		bool finished = false;
+		if (playing_sample.stream) {
+			Sound::Stream::Decoder &stream = *playing_sample.stream;
+			constexpr uint32_t const Capacity = Sound::Stream::Decoder::Capacity;
+
+			//skip anything decoded before the most recent seek:
+			uint64_t read = std::max(stream.read_position.load(std::memory_order_relaxed), stream.flush_position.load(std::memory_order_acquire));
+			//(check 'finished' before 'write_position' so that a finished stream is never missing its last samples)
+			bool seeking = (stream.seek_request.load(std::memory_order_acquire) >= 0);
+			bool decoded_all = stream.finished.load(std::memory_order_acquire);
+			uint64_t write = stream.write_position.load(std::memory_order_acquire);
+
+			//mix whatever has been decoded, in (at most two) contiguous runs of the ring:
+			// (if the decoder has fallen behind, the rest of the block is left silent)
+			for (uint32_t i = 0; i < MIX_SAMPLES && read < write; /* later */) {
+				uint32_t offset = uint32_t(read & (Capacity - 1));
+				uint32_t count = uint32_t(std::min< uint64_t >({ MIX_SAMPLES - i, write - read, Capacity - offset }));
+				mix_mono_to_stereo(&buffer[i].l, &stream.ring[offset], count,
+					start_pan.l + float(i) * pan_step.l, start_pan.r + float(i) * pan_step.r,
+					pan_step.l, pan_step.r);
+				i += count;
+				read += count;
+			}
+			stream.read_position.store(read, std::memory_order_release);
 
-			//update position in sample:
-			playing_sample.i += 1;
-			if (playing_sample.i == playing_sample.data.size()) {
-				if (playing_sample.loop) {
-					playing_sample.i = 0;
-				} else {
-					break;
+			finished = (decoded_all && !seeking && read == write);
+		} else {
+			std::vector< float > const &data = *playing_sample.data;
+			assert(playing_sample.i < data.size());
+
+			//mix in contiguous runs of sample data, splitting only where the sample ends or loops:
+			for (uint32_t i = 0; i < MIX_SAMPLES; /* later */) {
+				uint32_t count = std::min(MIX_SAMPLES - i, uint32_t(data.size()) - playing_sample.i);
+				mix_mono_to_stereo(&buffer[i].l, &data[playing_sample.i], count,
+					start_pan.l + float(i) * pan_step.l, start_pan.r + float(i) * pan_step.r,
+					pan_step.l, pan_step.r);
+				i += count;
+
+				//update position in sample:
+				playing_sample.i += count;
+				if (playing_sample.i == data.size()) {
+					if (playing_sample.loop) {
+						playing_sample.i = 0;
+					} else {
+						break;
+					}
 				}
 			}
 
-			//update pan values:
-			pan.l += pan_step.l;
-			pan.r += pan_step.r;
+			finished = (playing_sample.i >= data.size());
 		}
 
-		if (playing_sample.i >= playing_sample.data.size()
+		if (finished
 		 || (playing_sample.stopping && playing_sample.volume.value == 0.0f)) { //sample has finished
-		 	playing_sample.stopped = true;
-			//erase from list:
-			auto old = si;
-			++si;
-			playing_samples.erase(old);
+			//hand voice back to the game thread for reuse:
+			// (order of playing list doesn't matter, so release_voice swaps with the last entry)
+			release_voice(pv);
 		} else {
-			++si;
+			++pv;
 		}
 	}
 
@@ -430,9 +905,16 @@ void mix_audio(void *, Uint8 *buffer_, int len) {
 	for (uint32_t s = 0; s < MIX_SAMPLES; ++s) {
 		max_power = std::max(max_power, (buffer[s].l * buffer[s].l + buffer[s].r * buffer[s].r));
 	}
-	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_samples.size() << std::endl; //DEBUG
+	std::cout << "Max Power: " << std::sqrt(max_power) << "; playing samples: " << playing_voices.size() << std::endl; //DEBUG
 	*/
 
+	//record statistics:
+	uint32_t mix_ns = uint32_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - mix_start).count());
+	stats_playing_voices.store(uint32_t(playing_voices.size()), std::memory_order_relaxed);
+	stats_mix_ns.store(mix_ns, std::memory_order_relaxed);
+	uint32_t max_ns = stats_max_mix_ns.load(std::memory_order_relaxed);
+	while (mix_ns > max_ns && !stats_max_mix_ns.compare_exchange_weak(max_ns, mix_ns, std::memory_order_relaxed)) { }
+
 }
 
 
@@ -6,6 +6,7 @@
 #include <vector>
 #include <string>
 #include <cmath>
+#include <limits>
 
 //Game audio system. Simplified from f18-base3.
 //Uses 48kHz sampling rate.
@@ -48,10 +49,13 @@ struct Ramp {
 	float ramp = 0.0f;
 };
 
-// 'PlayingSample' objects book-keep samples that are currently playing:
+// 'PlayingSample' objects are handles to samples that are currently playing:
+// (handles are small values -- copy them freely; once playback finishes they just stop doing anything)
 struct PlayingSample {
-	//change the panning or volume of a playing sample (and do proper locking);
+	//change the panning or volume of a playing sample;
 	// value will change over 'ramp' seconds to avoid creating audible artifacts:
+	//NOTE: these functions (and the play/loop/stop/set_* functions below) queue changes for the
+	// audio thread without locking; call them from a single thread (generally the game thread).
 	void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 	//set the panning of a sample (use only on samples in "2D" mode; no effect on "3D" samples):
 	void set_pan(float new_pan, float ramp = 1.0f / 60.0f);
@@ -63,45 +67,81 @@ struct PlayingSample {
 	//'stop' will fade sample out over 'ramp' seconds and then remove it from the active samples:
 	void stop(float ramp = 1.0f / 60.0f);
 
+	//was playback stopped (either by running out of sample, or by stop())?
+	bool stopped() const;
+
 	//internals:
-	//NOTE: PlayingSample is used in a separate thread; so setting these values directly
-	// may result in bad results. Instead, use the functions above, which perform locking!
-	std::vector< float > const &data; //reference to sample data being played
-	uint32_t i = 0; //next data value to read
-	bool loop = false; //should playback loop after data runs out?
-	bool stopping = false; //is playing stopping?
-	bool stopped = false; //was playback stopped (either by running out of sample, or by stop())?
-
-	Ramp< float > volume = Ramp< float >(1.0f);
-
-	//2D playback panning control: ('NaN' if sound played in 3D mode)
-	Ramp< float > pan = Ramp< float >(std::numeric_limits< float >::quiet_NaN());
-
-	//3D playback panning control: ('NaN' if sound played in 2D mode)
-	Ramp< glm::vec3 > position = Ramp< glm::vec3 >(std::numeric_limits< float >::quiet_NaN());
-	Ramp< float > half_volume_radius = std::numeric_limits< float >::quiet_NaN();
-
-	PlayingSample(Sample const &sample_, float volume_, float pan_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), pan(pan_) { }
-	PlayingSample(Sample const &sample_, float volume_, glm::vec3 const &position_, float half_volume_radius_, bool loop_)
-		: data(sample_.data), loop(loop_), volume(volume_), position(position_), half_volume_radius(half_volume_radius_) { }
+	//NOTE: the actual playback state lives in a fixed-size pool of voices inside Sound.cpp;
+	// a handle names a slot in that pool, and the generation is checked so that stale handles
+	// (to slots that have since been reused by other samples) are ignored:
+	uint32_t index = -1U;
+	uint32_t generation = 0;
+};
+
+//Stream objects play long '.opus' files (e.g., music) without decoding them fully into memory:
+// a background thread decodes a few seconds ahead of playback into a ring buffer.
+//NOTE: a stream can only be played once at a time; destroying a stream stops its playback.
+struct Stream {
+	//open a file and start decoding in the background; throws if file can't be opened:
+	Stream(std::string const &filename);
+	~Stream();
+
+	//jump to 'time' seconds from the start of the stream:
+	// (streams play from wherever they were left, so use seek(0.0f) to start over)
+	void seek(float time);
+
+	//the decoding thread refers to the stream, so it can't be copied:
+	Stream(Stream const &) = delete;
+	Stream &operator=(Stream const &) = delete;
+
+	//internals:
+	struct Decoder; //ring buffer + decoding thread; defined in Sound.cpp
+	std::unique_ptr< Decoder > decoder;
+	PlayingSample playing; //handle to the voice playing this stream (if any)
 };
 
 // ------- global functions -------
 
+//output format: 48kHz, stereo, floating point; mixed in blocks of BlockSize frames:
+constexpr uint32_t const AudioRate = 48000;
+constexpr uint32_t const BlockSize = 1024;
+
+//maximum number of samples that can play at once:
+// (voices are allocated up front in Sound::init(); playing a sample never allocates)
+constexpr uint32_t const MaxPlayingSamples = 4096;
+
 void init(); //call Sound::init() from main.cpp before using any member functions
 
 void shutdown(); //call Sound::shutdown() from main.cpp to gracefully(-ish) exit
 
+//Headless rendering runs the mixer without an audio device (benchmarks, offline bounces, CI machines):
+//call Sound::init_headless() instead of Sound::init() to set up the mixer without opening a device:
+void init_headless();
+//mix the next 'blocks' blocks of audio into 'buffer', as fast as possible:
+// (buffer holds blocks * BlockSize interleaved left/right pairs, i.e., 2 * blocks * BlockSize floats)
+void render(float *buffer, uint32_t blocks);
+//mix the next 'blocks' blocks of audio into a (32-bit float, stereo) '.wav' file:
+// throws on file errors
+void render_to_wav(std::string const &filename, uint32_t blocks);
+
+//Statistics about the mixer (for performance displays; safe to call from any thread):
+struct MixStats {
+	uint32_t playing_voices = 0; //voices being mixed as of the most recent block
+	float mix_ms = 0.0f; //time the most recent block took to mix
+	float max_mix_ms = 0.0f; //longest time a block took to mix since the previous get_mix_stats()
+};
+MixStats get_mix_stats();
+
 //Call 'Sound::play' to play a sample once.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback early.
-std::shared_ptr< PlayingSample > play(
+//  (if all MaxPlayingSamples voices are busy, the sample is not played and the returned handle is inert)
+PlayingSample play(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The play_3D version will play a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > play_3D(
+PlayingSample play_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
@@ -110,19 +150,32 @@ std::shared_ptr< PlayingSample > play_3D(
 
 //Call 'Sound::loop' to play a sample ~forever~.
 //  if you hang on to the return value, you can change the panning, volume, or stop playback.
-std::shared_ptr< PlayingSample > loop(
+PlayingSample loop(
 	Sample const &sample,
 	float volume = 1.0f,
 	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
 );
 //The loop_3D version will loop a sample in '3D' mode (that is, panning determined by listener position):
-std::shared_ptr< PlayingSample > loop_3D(
+PlayingSample loop_3D(
 	Sample const &sample,
 	float volume,
 	glm::vec3 const &position,
 	float half_volume_radius = std::numeric_limits< float >::infinity()
 );
 
+//Call 'Sound::play' or 'Sound::loop' with a Stream to play it in 2D:
+//  (a stream that is already playing won't be started again; the returned handle will be inert)
+PlayingSample play(
+	Stream &stream,
+	float volume = 1.0f,
+	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+);
+PlayingSample loop(
+	Stream &stream,
+	float volume = 1.0f,
+	float pan = 0.0f //-1.0f == hard left, 1.0f == hard right
+);
+
 //Listener controls the panning of "3D" samples (ones played using the "position" version of the play functions):
 struct Listener {
 	void set_position_right(glm::vec3 const &new_position, glm::vec3 const &new_right, float ramp = 1.0f / 60.0f);
@@ -141,8 +194,8 @@ void set_volume(float new_volume, float ramp = 1.0f / 60.0f);
 extern Ramp< float > volume;
 
 //the audio callback doesn't run between Sound::lock() and Sound::unlock()
-// the set_*/stop/play/... functions already use these helpers, so you shouldn't need
-// to call them unless your code is modifying values directly:
+// the set_*/stop/play/... functions send their changes through a lock-free queue instead,
+// so you only need these if your code is modifying values (e.g., Sound::volume) directly:
 void lock();
 void unlock();
 
@@ -0,0 +1,37 @@
+#include "SpatialHash.hpp"
+
+#include <cassert>
+
+void SpatialHash::build(glm::vec2 const *points, uint32_t count) {
+	assert(cell_size > 0.0f);
+
+	//table with (about) as many entries as points:
+	// (collisions just mean a few extra entry_cells comparisons in queries)
+	uint32_t table_size = 1;
+	while (table_size < count) table_size *= 2;
+	table_mask = table_size - 1;
+
+	entries.resize(count);
+	entry_cells.resize(count);
+	point_cells.resize(count);
+	point_hashes.resize(count);
+
+	//counting sort of points by table entry:
+	// (table_starts[h+1] counts points in entry h, then becomes the end of entry h's range)
+	table_starts.assign(table_size + 1, 0);
+	for (uint32_t i = 0; i < count; ++i) {
+		point_cells[i] = cell(points[i]);
+		point_hashes[i] = hash(point_cells[i]);
+		table_starts[point_hashes[i] + 1] += 1;
+	}
+	for (uint32_t h = 0; h < table_size; ++h) {
+		table_starts[h+1] += table_starts[h];
+	}
+
+	fill.assign(table_starts.begin(), table_starts.end() - 1);
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t e = fill[point_hashes[i]]++;
+		entries[e] = i;
+		entry_cells[e] = point_cells[i];
+	}
+}
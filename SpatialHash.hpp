@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * A SpatialHash buckets 2D points into a uniform grid of square cells,
+ * hashed into a table, so that points near a location can be found
+ * without looking at every point.
+ *
+ * It is meant to be rebuilt (in linear time, via a counting sort) whenever
+ * the points move -- e.g., once per frame.
+ *
+ */
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+struct SpatialHash {
+	SpatialHash(float cell_size_ = 1.0f) : cell_size(cell_size_) { }
+
+	//size of grid cells; works best at about the size of a typical query radius:
+	float cell_size;
+
+	//replace the contents of the hash with points[0] .. points[count-1]:
+	// (points are referred to by index in queries)
+	void build(glm::vec2 const *points, uint32_t count);
+
+	//call fn(index) for every point in a cell that overlaps the square around the circle (center, radius):
+	// (so fn is passed every point within radius of center, and a few others; check distances in fn)
+	template< typename F >
+	void query(glm::vec2 const &center, float radius, F const &fn) const;
+
+	//internals:
+	glm::ivec2 cell(glm::vec2 const &point) const {
+		return glm::ivec2(int32_t(std::floor(point.x / cell_size)), int32_t(std::floor(point.y / cell_size)));
+	}
+	uint32_t hash(glm::ivec2 const &c) const {
+		return (uint32_t(c.x) * 92837111U ^ uint32_t(c.y) * 689287499U) & table_mask;
+	}
+	uint32_t table_mask = 0; //table size is a power of two, so hashes are masked to pick an entry
+	std::vector< uint32_t > table_starts; //points hashed to table entry h are entries[table_starts[h]] .. entries[table_starts[h+1]-1]
+	std::vector< uint32_t > entries; //point indices, grouped by table entry
+	std::vector< glm::ivec2 > entry_cells; //cell of each entry (since several cells may share a table entry)
+	std::vector< glm::ivec2 > point_cells; //used by build(): cell of each point
+	std::vector< uint32_t > point_hashes; //used by build(): table entry of each point
+	std::vector< uint32_t > fill; //used by build(): next entry to fill for each table entry
+};
+
+template< typename F >
+void SpatialHash::query(glm::vec2 const &center, float radius, F const &fn) const {
+	if (entries.empty()) return;
+	glm::ivec2 min = cell(center - glm::vec2(radius));
+	glm::ivec2 max = cell(center + glm::vec2(radius));
+	for (int32_t y = min.y; y <= max.y; ++y) {
+		for (int32_t x = min.x; x <= max.x; ++x) {
+			glm::ivec2 c(x, y);
+			uint32_t h = hash(c);
+			for (uint32_t e = table_starts[h]; e < table_starts[h+1]; ++e) {
+				if (entry_cells[e] == c) fn(entries[e]);
+			}
+		}
+	}
+}
@@ -0,0 +1,127 @@
+#include "StatsOverlay.hpp"
+
+#include "DrawLines.hpp"
+#include "Sound.hpp"
+#include "GL.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+void StatsOverlay::draw(glm::uvec2 const &drawable_size, Scene::DrawStats const &draw_stats) {
+	auto now = std::chrono::steady_clock::now();
+
+	//record time since the previous frame:
+	if (has_previous_draw) {
+		frame_ms[next_frame] = std::chrono::duration< float, std::milli >(now - previous_draw).count();
+		next_frame = (next_frame + 1) % History;
+		frames = std::min(frames + 1, History);
+	}
+	previous_draw = now;
+	has_previous_draw = true;
+
+	if (!visible) return;
+
+	glDisable(GL_DEPTH_TEST);
+
+	{ //draw everything in one batch, in pixel coordinates (origin at the lower left):
+		DrawLines lines(glm::mat4(
+			2.0f / drawable_size.x, 0.0f, 0.0f, 0.0f,
+			0.0f, 2.0f / drawable_size.y, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			-1.0f, -1.0f, 0.0f, 1.0f
+		));
+
+		constexpr float Margin = 8.0f; //space around the overlay
+		constexpr float TextHeight = 12.0f;
+		constexpr float LineHeight = 16.0f;
+		constexpr uint32_t TextLines = 5;
+		constexpr float GraphHeight = 60.0f;
+		constexpr float GraphMaxMs = 50.0f; //frame time at the top of the graph
+
+		float left = Margin;
+		float top = float(drawable_size.y) - Margin;
+
+		if (text_attribs.empty() || text_drawable_size != drawable_size
+		 || std::chrono::duration< float >(now - text_time).count() >= TextInterval) {
+			text_time = now;
+			text_drawable_size = drawable_size;
+
+			//frame time percentiles:
+			float p50 = 0.0f, p99 = 0.0f, max = 0.0f;
+			if (frames > 0) {
+				std::array< float, History > sorted;
+				std::copy(frame_ms.begin(), frame_ms.begin() + frames, sorted.begin());
+				auto percentile = [&](float p) {
+					auto nth = sorted.begin() + std::min(frames - 1, uint32_t(p * frames));
+					std::nth_element(sorted.begin(), nth, sorted.begin() + frames);
+					return *nth;
+				};
+				p50 = percentile(0.50f);
+				p99 = percentile(0.99f);
+				max = *std::max_element(sorted.begin(), sorted.begin() + frames);
+			}
+
+			Sound::MixStats mix_stats = Sound::get_mix_stats();
+
+			//text (with a shadow, so it is readable over anything):
+			uint32_t line = 0;
+			auto text = [&](char const *str) {
+				line += 1;
+				glm::vec3 anchor = glm::vec3(left, top - float(line) * LineHeight, 0.0f);
+				glm::vec3 x = glm::vec3(TextHeight, 0.0f, 0.0f);
+				glm::vec3 y = glm::vec3(0.0f, TextHeight, 0.0f);
+				lines.draw_text(str, anchor + glm::vec3(1.0f,-1.0f, 0.0f), x, y, glm::u8vec4(0x00, 0x00, 0x00, 0xff));
+				lines.draw_text(str, anchor, x, y, glm::u8vec4(0xff, 0xff, 0xff, 0xff));
+			};
+			char buffer[128];
+
+			std::snprintf(buffer, sizeof(buffer), "frame %.2fms  p50 %.2f  p99 %.2f  max %.2f",
+				frames ? frame_ms[(next_frame + History - 1) % History] : 0.0f, p50, p99, max);
+			text(buffer);
+
+			std::snprintf(buffer, sizeof(buffer), "draws %u (%u instanced)  tris %u  state changes %u",
+				draw_stats.draws, draw_stats.instanced_draws, draw_stats.triangles,
+				draw_stats.program_changes + draw_stats.vao_changes + draw_stats.texture_changes);
+			text(buffer);
+
+			std::snprintf(buffer, sizeof(buffer), "drawables visible %u  culled %u",
+				draw_stats.visible, draw_stats.culled);
+			text(buffer);
+
+			std::snprintf(buffer, sizeof(buffer), "voices %u  mix %.3fms (max %.3f of %.1f)",
+				mix_stats.playing_voices, mix_stats.mix_ms, mix_stats.max_mix_ms,
+				1000.0f * float(Sound::BlockSize) / float(Sound::AudioRate));
+			text(buffer);
+
+			std::snprintf(buffer, sizeof(buffer), "overlay %.3fms", overlay_ms);
+			text(buffer);
+
+			assert(line == TextLines);
+			text_attribs = lines.attribs;
+		} else {
+			lines.attribs = text_attribs;
+		}
+
+		{ //frame time graph (oldest on the left), one vertical line per frame:
+			float bottom = top - float(TextLines) * LineHeight - Margin - GraphHeight;
+			auto ms_to_y = [&](float ms) {
+				return bottom + GraphHeight * std::min(ms, GraphMaxMs) / GraphMaxMs;
+			};
+			for (uint32_t i = 0; i < frames; ++i) {
+				float ms = frame_ms[(next_frame + History - frames + i) % History];
+				glm::u8vec4 color = glm::u8vec4(0x44, 0xdd, 0x44, 0xff); //60fps or better
+				if (ms > 1000.0f / 60.0f + 1.0f) color = glm::u8vec4(0xee, 0xcc, 0x22, 0xff);
+				if (ms > 1000.0f / 30.0f + 1.0f) color = glm::u8vec4(0xee, 0x33, 0x33, 0xff);
+				float x = left + float(History - frames + i) + 0.5f;
+				lines.draw(glm::vec3(x, bottom, 0.0f), glm::vec3(x, ms_to_y(ms), 0.0f), color);
+			}
+			//reference lines at 60fps and 30fps, plus the graph's bottom edge:
+			for (float ms : {0.0f, 1000.0f / 60.0f, 1000.0f / 30.0f}) {
+				lines.draw(glm::vec3(left, ms_to_y(ms), 0.0f), glm::vec3(left + float(History), ms_to_y(ms), 0.0f), glm::u8vec4(0xff, 0xff, 0xff, 0x88));
+			}
+		}
+	} //(lines are drawn here)
+
+	overlay_ms = std::chrono::duration< float, std::milli >(std::chrono::steady_clock::now() - now).count();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ * StatsOverlay draws a small on-screen display of performance statistics
+ * (built on DrawLines, so it needs no resources of its own):
+ *  - a graph of recent frame times, with percentiles,
+ *  - what the most recent Scene::draw did (Scene::DrawStats),
+ *  - and how busy the audio mixer is (Sound::MixStats).
+ *
+ * Usage (in a mode's draw function, after everything else is drawn):
+ *   stats_overlay.draw(drawable_size, scene.draw_stats);
+ *
+ * Frame times are measured between calls to draw(), so draw() should be called
+ *  every frame (it records the time but doesn't draw anything when !visible).
+ *
+ * The graph is redrawn every frame, but the text is only laid out again every
+ *  TextInterval seconds (so it is readable, and so the overlay stays cheap).
+ *
+ */
+
+#include "Scene.hpp"
+#include "DrawLines.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+struct StatsOverlay {
+	bool visible = false;
+
+	//record the frame time and (if visible) draw the overlay over the top-left of the screen:
+	void draw(glm::uvec2 const &drawable_size, Scene::DrawStats const &draw_stats);
+
+	//internals:
+	static constexpr uint32_t History = 240; //frame times kept (also the width of the graph, in pixels)
+	std::array< float, History > frame_ms; //ring buffer of frame times, in milliseconds
+	uint32_t next_frame = 0; //where the next frame time goes in frame_ms
+	uint32_t frames = 0; //number of frame times recorded (up to History)
+	std::chrono::steady_clock::time_point previous_draw;
+	bool has_previous_draw = false;
+	float overlay_ms = 0.0f; //time the previous overlay took to build and draw
+
+	static constexpr float TextInterval = 0.25f;
+	std::vector< DrawLines::Vertex > text_attribs; //most recently laid-out text
+	std::chrono::steady_clock::time_point text_time; //when text_attribs was laid out
+	glm::uvec2 text_drawable_size = glm::uvec2(0); //drawable size text_attribs was laid out for
+};
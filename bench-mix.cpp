@@ -0,0 +1,89 @@
+//Microbenchmark for the mix_mono_to_stereo kernel used by Sound's mixer.
+// Build + run with:
+//  $ node Maekfile.js :bench-mix
+
+#include "mix_mono_to_stereo.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main(int, char **) {
+	constexpr uint32_t const MIX_SAMPLES = 1024; //matches Sound.cpp's block size
+	constexpr uint32_t const SAMPLE_LENGTH = 48000; //one second of source audio
+
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > noise(-1.0f, 1.0f);
+
+	std::vector< float > sample(SAMPLE_LENGTH);
+	for (auto &s : sample) s = noise(mt);
+
+	std::cout << "mix_mono_to_stereo kernel: " << mix_mono_to_stereo_isa << std::endl;
+
+	//--- check vectorized kernel against scalar reference ---
+	{
+		float max_error = 0.0f;
+		for (uint32_t count : {0U, 1U, 3U, 4U, 7U, 8U, 9U, 31U, 1000U, MIX_SAMPLES}) {
+			std::vector< float > a(2 * MIX_SAMPLES), b(2 * MIX_SAMPLES);
+			for (uint32_t i = 0; i < a.size(); ++i) a[i] = b[i] = noise(mt);
+			float start_l = noise(mt), start_r = noise(mt);
+			float step_l = noise(mt) / MIX_SAMPLES, step_r = noise(mt) / MIX_SAMPLES;
+			uint32_t offset = uint32_t(mt() % (SAMPLE_LENGTH - MIX_SAMPLES));
+			mix_mono_to_stereo(a.data(), sample.data() + offset, count, start_l, start_r, step_l, step_r);
+			mix_mono_to_stereo_scalar(b.data(), sample.data() + offset, count, start_l, start_r, step_l, step_r);
+			for (uint32_t i = 0; i < a.size(); ++i) {
+				max_error = std::max(max_error, std::abs(a[i] - b[i]));
+			}
+		}
+		std::cout << "  max |vectorized - scalar| = " << max_error << (max_error <= 1e-6f ? " (ok)" : " (TOO LARGE)") << std::endl;
+		if (max_error > 1e-6f) return 1;
+	}
+
+	//--- time both kernels with various voice counts ---
+	auto run = [&](uint32_t voices, bool vectorized) {
+		std::vector< float > buffer(2 * MIX_SAMPLES, 0.0f);
+		std::vector< uint32_t > positions(voices);
+		for (auto &p : positions) p = uint32_t(mt() % (SAMPLE_LENGTH - MIX_SAMPLES));
+
+		//mix enough blocks to take a measurable amount of time:
+		uint32_t blocks = std::max(8U, 65536U / voices);
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t b = 0; b < blocks; ++b) {
+			std::fill(buffer.begin(), buffer.end(), 0.0f);
+			for (uint32_t v = 0; v < voices; ++v) {
+				float const *in = sample.data() + positions[v];
+				if (vectorized) {
+					mix_mono_to_stereo(buffer.data(), in, MIX_SAMPLES, 0.5f, 0.5f, 1e-5f, -1e-5f);
+				} else {
+					mix_mono_to_stereo_scalar(buffer.data(), in, MIX_SAMPLES, 0.5f, 0.5f, 1e-5f, -1e-5f);
+				}
+			}
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double ms = std::chrono::duration< double, std::milli >(after - before).count();
+
+		//(keep a value that depends on the buffer so the work can't be optimized away)
+		static volatile float sink = 0.0f;
+		sink = sink + buffer[0];
+
+		return double(voices) * double(blocks) / ms; //voices mixed per millisecond
+	};
+
+	std::cout << "  (one voice == " << MIX_SAMPLES << " frames)" << std::endl;
+	std::cout << std::setw(8) << "voices" << std::setw(18) << "scalar voices/ms" << std::setw(18) << "vector voices/ms" << std::setw(10) << "speedup" << std::endl;
+	for (uint32_t voices : {1U, 16U, 256U, 4096U}) {
+		double scalar = run(voices, false);
+		double vector = run(voices, true);
+		std::cout << std::setw(8) << voices
+		          << std::setw(18) << std::fixed << std::setprecision(1) << scalar
+		          << std::setw(18) << vector
+		          << std::setw(9) << std::setprecision(2) << (vector / scalar) << "x" << std::endl;
+	}
+
+	return 0;
+}
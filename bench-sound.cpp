@@ -0,0 +1,124 @@
+//Benchmark for the Sound mixer, run headless (no audio device needed).
+// Build + run with:
+//  $ node Maekfile.js :bench-sound
+// Pass a filename to also bounce a short mix to a '.wav' file:
+//  $ bench/bench-sound out.wav
+
+#include "Sound.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main(int argc, char **argv) {
+	Sound::init_headless();
+
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+
+	//synthetic source audio: a long-ish noise burst for looping voices,
+	// and a short decaying tone for one-shots (so they finish and get re-triggered during the run):
+	std::vector< float > noise(2 * Sound::AudioRate);
+	for (auto &n : noise) n = 0.1f * unit(mt);
+	Sound::Sample noise_sample(noise);
+
+	std::vector< float > ping(Sound::AudioRate / 4);
+	for (uint32_t i = 0; i < ping.size(); ++i) {
+		float t = float(i) / float(Sound::AudioRate);
+		ping[i] = 0.1f * std::sin(2.0f * 3.1415926f * 440.0f * t) * std::exp(-8.0f * t);
+	}
+	Sound::Sample ping_sample(ping);
+
+	constexpr uint32_t const BLOCKS = 128; //blocks timed per configuration
+	double const block_budget_ns = 1e9 * double(Sound::BlockSize) / double(Sound::AudioRate);
+
+	std::vector< float > block(2 * Sound::BlockSize);
+
+	std::cout << "Mixing " << BLOCKS << " blocks of " << Sound::BlockSize << " frames per configuration (real-time budget: "
+		<< std::fixed << std::setprecision(0) << block_budget_ns << " ns/block)." << std::endl;
+	std::cout << std::setw(7) << "voices" << std::setw(4) << "" << std::setw(10) << "mode"
+		<< std::setw(14) << "ns/block" << std::setw(14) << "ns/voice" << std::setw(14) << "worst ns" << std::setw(12) << "x realtime" << std::endl;
+
+	for (uint32_t voices : {1U, 16U, 64U, 256U, 1024U, 4096U}) {
+		for (bool is_3D : {false, true}) {
+			for (bool looping : {true, false}) {
+				Sound::Sample const &sample = (looping ? noise_sample : ping_sample);
+				auto random_position = [&]() {
+					return glm::vec3(10.0f * unit(mt), 10.0f * unit(mt), unit(mt));
+				};
+				auto start = [&]() -> Sound::PlayingSample {
+					float volume = 0.5f + 0.5f * unit(mt);
+					if (is_3D) {
+						if (looping) return Sound::loop_3D(sample, volume, random_position(), 5.0f);
+						else return Sound::play_3D(sample, volume, random_position(), 5.0f);
+					} else {
+						if (looping) return Sound::loop(sample, volume, unit(mt));
+						else return Sound::play(sample, volume, unit(mt));
+					}
+				};
+
+				std::vector< Sound::PlayingSample > playing;
+				playing.reserve(voices);
+				for (uint32_t v = 0; v < voices; ++v) {
+					playing.emplace_back(start());
+				}
+
+				double total_ns = 0.0;
+				double worst_ns = 0.0;
+				for (uint32_t b = 0; b < BLOCKS; ++b) {
+					//like a game would, move things around between blocks:
+					if (is_3D) {
+						Sound::listener.set_position_right(random_position(), glm::vec3(1.0f, 0.0f, 0.0f), 1.0f / 60.0f);
+						for (uint32_t v = b % 8; v < playing.size(); v += 8) {
+							playing[v].set_position(random_position(), 1.0f / 60.0f);
+						}
+					}
+					//re-trigger finished one-shots:
+					for (auto &p : playing) {
+						if (p.stopped()) p = start();
+					}
+
+					auto before = std::chrono::high_resolution_clock::now();
+					Sound::render(block.data(), 1);
+					auto after = std::chrono::high_resolution_clock::now();
+					double ns = std::chrono::duration< double, std::nano >(after - before).count();
+					total_ns += ns;
+					worst_ns = std::max(worst_ns, ns);
+				}
+
+				double per_block = total_ns / BLOCKS;
+				std::cout << std::setw(7) << voices << std::setw(4) << (is_3D ? "3D" : "2D") << std::setw(10) << (looping ? "loop" : "one-shot")
+					<< std::setw(14) << std::setprecision(0) << per_block
+					<< std::setw(14) << std::setprecision(1) << per_block / voices
+					<< std::setw(14) << std::setprecision(0) << worst_ns
+					<< std::setw(12) << std::setprecision(1) << block_budget_ns / per_block << std::endl;
+
+				//silence everything before the next configuration:
+				Sound::stop_all_samples();
+				for (uint32_t b = 0; b < 4; ++b) {
+					Sound::render(block.data(), 1);
+				}
+			}
+		}
+	}
+
+	if (argc > 1) {
+		std::string filename = argv[1];
+		std::cout << "Bouncing five seconds of 3D pings to '" << filename << "'..." << std::endl;
+		for (uint32_t i = 0; i < 16; ++i) {
+			float ang = i / 16.0f * 2.0f * 3.1415926f;
+			Sound::loop_3D(ping_sample, 1.0f, glm::vec3(std::cos(ang), std::sin(ang), 0.0f) * 4.0f, 2.0f);
+		}
+		Sound::render_to_wav(filename, 5 * Sound::AudioRate / Sound::BlockSize);
+	}
+
+	Sound::shutdown();
+
+	return 0;
+}
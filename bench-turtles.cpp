@@ -0,0 +1,99 @@
+//Microbenchmark for the step_turtles kernel used by PlayMode's turtle simulation.
+// Build + run with:
+//  $ node Maekfile.js :bench-turtles
+
+#include "step_turtles.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+int main(int, char **) {
+	//simulation parameters (matching PlayMode):
+	constexpr float const Elapsed = 1.0f / 60.0f;
+	constexpr float const Speed = 5.0f;
+	constexpr float const TurnSpeed = 1.5f;
+	constexpr float const PondRadius = 50.0f;
+
+	std::mt19937 mt(0x15466);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+
+	auto make_turtles = [&](uint32_t count) {
+		TurtleArrays turtles;
+		turtles.resize(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			float r = PondRadius * std::sqrt(unit(mt));
+			float a = 6.2831853f * unit(mt);
+			turtles.x[i] = r * std::cos(a);
+			turtles.y[i] = r * std::sin(a);
+			turtles.angle[i] = 6.2831853f * unit(mt) - 3.1415926f;
+			turtles.turn_dir[i] = float(int32_t(mt() % 3) - 1);
+		}
+		return turtles;
+	};
+
+	std::cout << "step_turtles kernel: " << step_turtles_isa << std::endl;
+
+	//--- check vectorized kernel against scalar reference ---
+	{
+		float max_error = 0.0f;
+		for (uint32_t count : {0U, 1U, 3U, 4U, 5U, 8U, 1000U}) {
+			TurtleArrays a = make_turtles(count);
+			TurtleArrays b = a;
+			//(one step, so errors don't get a chance to compound; crossing the pond's edge is exercised by the turtles that start near it)
+			step_turtles(a, Elapsed, Speed, TurnSpeed, PondRadius);
+			step_turtles_scalar(b, Elapsed, Speed, TurnSpeed, PondRadius);
+			for (uint32_t i = 0; i < count; ++i) {
+				max_error = std::max(max_error, std::abs(a.x[i] - b.x[i]) / PondRadius);
+				max_error = std::max(max_error, std::abs(a.y[i] - b.y[i]) / PondRadius);
+				//(compare headings by direction, since -pi and pi are the same heading)
+				max_error = std::max(max_error, std::abs(std::sin(0.5f * (a.angle[i] - b.angle[i]))));
+				max_error = std::max(max_error, std::abs(std::abs(a.half_cos[i]) - std::abs(b.half_cos[i])));
+				max_error = std::max(max_error, std::abs(std::abs(a.half_sin[i]) - std::abs(b.half_sin[i])));
+			}
+		}
+		std::cout << "  max relative |vectorized - scalar| = " << max_error << (max_error <= 1e-5f ? " (ok)" : " (TOO LARGE)") << std::endl;
+		if (max_error > 1e-5f) return 1;
+	}
+
+	//--- time both kernels with various turtle counts ---
+	auto run = [&](uint32_t count, bool vectorized) {
+		TurtleArrays turtles = make_turtles(count);
+
+		//step enough times to take a measurable amount of time:
+		uint32_t steps = std::max(8U, 4000000U / count);
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t s = 0; s < steps; ++s) {
+			if (vectorized) {
+				step_turtles(turtles, Elapsed, Speed, TurnSpeed, PondRadius);
+			} else {
+				step_turtles_scalar(turtles, Elapsed, Speed, TurnSpeed, PondRadius);
+			}
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double ns = std::chrono::duration< double, std::nano >(after - before).count();
+
+		//(keep a value that depends on the turtles so the work can't be optimized away)
+		static volatile float sink = 0.0f;
+		sink = sink + turtles.x[0];
+
+		return ns / (double(count) * double(steps)); //nanoseconds per turtle per step
+	};
+
+	std::cout << std::setw(8) << "turtles" << std::setw(18) << "scalar ns/turtle" << std::setw(18) << "vector ns/turtle" << std::setw(10) << "speedup" << std::endl;
+	for (uint32_t count : {1000U, 10000U, 100000U}) {
+		double scalar = run(count, false);
+		double vector = run(count, true);
+		std::cout << std::setw(8) << count
+		          << std::setw(18) << std::fixed << std::setprecision(2) << scalar
+		          << std::setw(18) << vector
+		          << std::setw(9) << std::setprecision(2) << (scalar / vector) << "x" << std::endl;
+	}
+
+	return 0;
+}
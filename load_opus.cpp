@@ -2,6 +2,7 @@
 
 #include <opusfile.h>
 
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <cmath>
@@ -52,3 +53,45 @@ void load_opus(std::string const &filename, std::vector< float > *data_) {
 
 	std::cout << " done." << std::endl;
 }
+
+OpusReader::OpusReader(std::string const &filename_) : filename(filename_) {
+	int err = 0;
+	op = op_open_file(filename.c_str(), &err);
+	if (err != 0 || !op) {
+		throw std::runtime_error("opusfile error " + std::to_string(err) + " opening \"" + filename + "\".");
+	}
+
+	ogg_int64_t total = op_pcm_total(op, -1);
+	length = (total >= 0 ? uint64_t(total) : 0);
+
+	pcm.resize(2*960*4); //reads are generally 960 samples, so this leaves plenty of room
+}
+
+OpusReader::~OpusReader() {
+	op_free(op);
+	op = nullptr;
+}
+
+uint32_t OpusReader::read(float *data, uint32_t count) {
+	assert(data || count == 0);
+	count = std::min(count, uint32_t(pcm.size() / 2));
+	if (count == 0) return 0;
+
+	int ret = op_read_float_stereo(op, pcm.data(), int(2 * count));
+	if (ret < 0) {
+		throw std::runtime_error("opusfile read error " + std::to_string(ret) + " reading \"" + filename + "\".");
+	}
+	//ret is the number of samples read per channel; downmix to mono by averaging:
+	assert(uint32_t(ret) <= count);
+	for (uint32_t i = 0; i < uint32_t(ret); ++i) {
+		data[i] = (pcm[2*i] + pcm[2*i+1]) * 0.5f;
+	}
+	return uint32_t(ret);
+}
+
+void OpusReader::seek(uint64_t sample) {
+	int ret = op_pcm_seek(op, ogg_int64_t(sample));
+	if (ret != 0) {
+		throw std::runtime_error("opusfile seek error " + std::to_string(ret) + " seeking in \"" + filename + "\".");
+	}
+}
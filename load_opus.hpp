@@ -1,7 +1,32 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 //Load an opus file as 48kHz floating-point mono; throws on error:
 void load_opus(std::string const &filename, std::vector< float > *data);
+
+//Incrementally decode an opus file as 48kHz floating-point mono (used for streaming long files):
+struct OggOpusFile;
+struct OpusReader {
+	//open a file for reading; throws on error:
+	OpusReader(std::string const &filename);
+	~OpusReader();
+
+	//decode up to 'count' samples into 'data'; returns number of samples decoded (0 at end of file); throws on error:
+	uint32_t read(float *data, uint32_t count);
+
+	//move to a given sample in the file; throws on error:
+	void seek(uint64_t sample);
+
+	//length of file in samples (or 0 if it can't be determined):
+	uint64_t length = 0;
+
+	OpusReader(OpusReader const &) = delete;
+
+	//internals:
+	std::string filename;
+	OggOpusFile *op = nullptr;
+	std::vector< float > pcm; //stereo data straight from the decoder, before downmixing
+};
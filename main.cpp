@@ -10,6 +10,9 @@
 //For sound init:
 #include "Sound.hpp"
 
+//for timing frames, exporting traces:
+#include "Profiler.hpp"
+
 //GL.hpp will include a non-namespace-polluting set of opengl prototypes:
 #include "GL.hpp"
 
@@ -25,6 +28,7 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <string>
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -105,6 +109,13 @@ int main(int argc, char **argv) {
 	//Hide mouse cursor (note: showing can be useful for debugging):
 	//SDL_ShowCursor(SDL_DISABLE);
 
+	//------------ init profiler --------------
+	//(recording starts right away with 'game --profile'; otherwise F9 toggles recording, and F10 saves 'profile.json')
+	Profiler::set_thread_name("main");
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--profile") Profiler::set_enabled(true);
+	}
+
 	//------------ init sound --------------
 	Sound::init();
 
@@ -112,7 +123,16 @@ int main(int argc, char **argv) {
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >());
+	//(the number of turtles can be set on the command line, e.g. 'game --turtles 100000')
+	//(as can a fixed simulation rate, in updates per second, e.g. 'game --tick-rate 30')
+	uint32_t turtle_count = 0;
+	float tick_rate = 0.0f;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (std::string(argv[i]) == "--turtles") turtle_count = uint32_t(std::stoul(argv[i+1]));
+		if (std::string(argv[i]) == "--tick-rate") tick_rate = std::stof(argv[i+1]);
+	}
+	Mode::set_current(std::make_shared< PlayMode >(turtle_count));
+	if (tick_rate > 0.0f) Mode::current->tick = 1.0f / tick_rate;
 
 	//------------ main loop ------------
 
@@ -135,8 +155,10 @@ int main(int argc, char **argv) {
 	while (Mode::current) {
 		//every pass through the game loop creates one frame of output
 		//  by performing three steps:
+		PROFILE_ZONE("frame");
 
 		{ //(1) process any events that are pending
+			PROFILE_ZONE("events");
 			static SDL_Event evt;
 			while (SDL_PollEvent(&evt) == 1) {
 				//handle resizing:
@@ -163,12 +185,26 @@ int main(int argc, char **argv) {
 						px.a = 0xff;
 					}
 					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F9) {
+					// --- profiler recording toggle key ---
+					Profiler::set_enabled(!Profiler::enabled());
+					std::cout << "Profiler " << (Profiler::enabled() ? "recording." : "paused.") << std::endl;
+				} else if (evt.type == SDL_KEYDOWN && evt.key.keysym.sym == SDLK_F10) {
+					// --- profile save key ---
+					std::string filename = "profile.json";
+					std::cout << "Saving profile to '" << filename << "' (open with chrome://tracing or https://ui.perfetto.dev)." << std::endl;
+					try {
+						Profiler::write_trace(filename);
+					} catch (std::exception &e) {
+						std::cerr << "WARNING: " << e.what() << std::endl;
+					}
 				}
 			}
 			if (!Mode::current) break;
 		}
 
 		{ //(2) call the current mode's "update" function to deal with elapsed time:
+			PROFILE_ZONE("update");
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time;
 			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
@@ -178,17 +214,36 @@ int main(int argc, char **argv) {
 			//lag to avoid spiral of death:
 			elapsed = std::min(0.1f, elapsed);
 
-			Mode::current->update(elapsed);
+			if (Mode::current->tick > 0.0f) {
+				//fixed timestep: update in steps of 'tick', carrying leftover time to the next frame:
+				std::shared_ptr< Mode > mode = Mode::current;
+				mode->tick_accumulator += elapsed;
+				while (mode->tick_accumulator >= mode->tick) {
+					mode->tick_accumulator -= mode->tick;
+					mode->update(mode->tick);
+					if (Mode::current != mode) break; //(mode changed during update)
+				}
+				mode->alpha = mode->tick_accumulator / mode->tick;
+			} else {
+				Mode::current->update(elapsed);
+			}
 			if (!Mode::current) break;
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
+			PROFILE_ZONE("draw");
+			Profiler::GPUZone gpu_zone("draw");
 			Mode::current->draw(drawable_size);
 		}
 
 		//Wait until the recently-drawn frame is shown before doing it all again:
-		SDL_GL_SwapWindow(window);
+		{
+			PROFILE_ZONE("swap");
+			SDL_GL_SwapWindow(window);
+		}
+
+		//Pick up GPU times from earlier frames:
+		Profiler::collect_gpu();
 	}
 
 
@@ -0,0 +1,133 @@
+#include "mix_mono_to_stereo.hpp"
+
+#if defined(__AVX__)
+	#include <immintrin.h>
+	#define MIX_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define MIX_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define MIX_NEON
+#endif
+
+void mix_mono_to_stereo_scalar(float *out, float const *in, uint32_t count,
+	float start_l, float start_r, float step_l, float step_r) {
+	for (uint32_t k = 0; k < count; ++k) {
+		out[2*k+0] += in[k] * (start_l + float(k) * step_l);
+		out[2*k+1] += in[k] * (start_r + float(k) * step_r);
+	}
+}
+
+#if defined(MIX_AVX)
+
+char const *mix_mono_to_stereo_isa = "AVX";
+
+void mix_mono_to_stereo(float *out, float const *in, uint32_t count,
+	float start_l, float start_r, float step_l, float step_r) {
+	__m256 const vstart_l = _mm256_set1_ps(start_l);
+	__m256 const vstart_r = _mm256_set1_ps(start_r);
+	__m256 const vstep_l = _mm256_set1_ps(step_l);
+	__m256 const vstep_r = _mm256_set1_ps(step_r);
+	__m256 vk = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); //frame indices (exact as floats up to 2^24)
+	__m256 const eight = _mm256_set1_ps(8.0f);
+
+	uint32_t k = 0;
+	for (; k + 8 <= count; k += 8) {
+		__m256 s = _mm256_loadu_ps(in + k);
+		__m256 l = _mm256_mul_ps(s, _mm256_add_ps(vstart_l, _mm256_mul_ps(vk, vstep_l)));
+		__m256 r = _mm256_mul_ps(s, _mm256_add_ps(vstart_r, _mm256_mul_ps(vk, vstep_r)));
+		//interleave; unpack works within 128-bit lanes, so this gives:
+		// lo = [l0 r0 l1 r1 | l4 r4 l5 r5], hi = [l2 r2 l3 r3 | l6 r6 l7 r7]
+		__m256 lo = _mm256_unpacklo_ps(l, r);
+		__m256 hi = _mm256_unpackhi_ps(l, r);
+		//...and then swap lanes around to get frames 0-3 and 4-7:
+		__m256 f0 = _mm256_permute2f128_ps(lo, hi, 0x20);
+		__m256 f1 = _mm256_permute2f128_ps(lo, hi, 0x31);
+		_mm256_storeu_ps(out + 2*k + 0, _mm256_add_ps(_mm256_loadu_ps(out + 2*k + 0), f0));
+		_mm256_storeu_ps(out + 2*k + 8, _mm256_add_ps(_mm256_loadu_ps(out + 2*k + 8), f1));
+		vk = _mm256_add_ps(vk, eight);
+	}
+	//leftover frames:
+	for (; k < count; ++k) {
+		out[2*k+0] += in[k] * (start_l + float(k) * step_l);
+		out[2*k+1] += in[k] * (start_r + float(k) * step_r);
+	}
+}
+
+#elif defined(MIX_SSE2)
+
+char const *mix_mono_to_stereo_isa = "SSE2";
+
+void mix_mono_to_stereo(float *out, float const *in, uint32_t count,
+	float start_l, float start_r, float step_l, float step_r) {
+	__m128 const vstart_l = _mm_set1_ps(start_l);
+	__m128 const vstart_r = _mm_set1_ps(start_r);
+	__m128 const vstep_l = _mm_set1_ps(step_l);
+	__m128 const vstep_r = _mm_set1_ps(step_r);
+	__m128 vk = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); //frame indices (exact as floats up to 2^24)
+	__m128 const four = _mm_set1_ps(4.0f);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		__m128 s = _mm_loadu_ps(in + k);
+		__m128 l = _mm_mul_ps(s, _mm_add_ps(vstart_l, _mm_mul_ps(vk, vstep_l)));
+		__m128 r = _mm_mul_ps(s, _mm_add_ps(vstart_r, _mm_mul_ps(vk, vstep_r)));
+		//interleave into [l0 r0 l1 r1] and [l2 r2 l3 r3]:
+		__m128 f0 = _mm_unpacklo_ps(l, r);
+		__m128 f1 = _mm_unpackhi_ps(l, r);
+		_mm_storeu_ps(out + 2*k + 0, _mm_add_ps(_mm_loadu_ps(out + 2*k + 0), f0));
+		_mm_storeu_ps(out + 2*k + 4, _mm_add_ps(_mm_loadu_ps(out + 2*k + 4), f1));
+		vk = _mm_add_ps(vk, four);
+	}
+	//leftover frames:
+	for (; k < count; ++k) {
+		out[2*k+0] += in[k] * (start_l + float(k) * step_l);
+		out[2*k+1] += in[k] * (start_r + float(k) * step_r);
+	}
+}
+
+#elif defined(MIX_NEON)
+
+char const *mix_mono_to_stereo_isa = "NEON";
+
+void mix_mono_to_stereo(float *out, float const *in, uint32_t count,
+	float start_l, float start_r, float step_l, float step_r) {
+	float32x4_t const vstart_l = vdupq_n_f32(start_l);
+	float32x4_t const vstart_r = vdupq_n_f32(start_r);
+	float32x4_t const vstep_l = vdupq_n_f32(step_l);
+	float32x4_t const vstep_r = vdupq_n_f32(step_r);
+	float const k0[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+	float32x4_t vk = vld1q_f32(k0); //frame indices (exact as floats up to 2^24)
+	float32x4_t const four = vdupq_n_f32(4.0f);
+
+	uint32_t k = 0;
+	for (; k + 4 <= count; k += 4) {
+		float32x4_t s = vld1q_f32(in + k);
+		//(vmulq + vaddq rather than vmlaq so the gain is computed the same way as the scalar code)
+		float32x4_t l = vmulq_f32(s, vaddq_f32(vstart_l, vmulq_f32(vk, vstep_l)));
+		float32x4_t r = vmulq_f32(s, vaddq_f32(vstart_r, vmulq_f32(vk, vstep_r)));
+		//vld2/vst2 (de-)interleave stereo frames for us:
+		float32x4x2_t lr = vld2q_f32(out + 2*k);
+		lr.val[0] = vaddq_f32(lr.val[0], l);
+		lr.val[1] = vaddq_f32(lr.val[1], r);
+		vst2q_f32(out + 2*k, lr);
+		vk = vaddq_f32(vk, four);
+	}
+	//leftover frames:
+	for (; k < count; ++k) {
+		out[2*k+0] += in[k] * (start_l + float(k) * step_l);
+		out[2*k+1] += in[k] * (start_r + float(k) * step_r);
+	}
+}
+
+#else
+
+char const *mix_mono_to_stereo_isa = "scalar";
+
+void mix_mono_to_stereo(float *out, float const *in, uint32_t count,
+	float start_l, float start_r, float step_l, float step_r) {
+	mix_mono_to_stereo_scalar(out, in, count, start_l, start_r, step_l, step_r);
+}
+
+#endif
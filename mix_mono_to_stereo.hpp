@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+//Mixing kernel used by Sound's mix_audio callback.
+//
+//Adds 'count' mono samples from 'in' into interleaved stereo 'out' (L R L R ...),
+// applying a per-channel gain that ramps linearly across the call:
+//   out[2*k+0] += in[k] * (start_l + k * step_l)
+//   out[2*k+1] += in[k] * (start_r + k * step_r)
+//
+//Uses AVX, SSE2, or NEON when the compiler targets them, and scalar code otherwise.
+//The vectorized paths evaluate exactly the expression above (no running sums), so they
+// match mix_mono_to_stereo_scalar bit-for-bit unless the compiler fuses the multiply-add;
+// with fused multiply-adds, results differ by at most 1e-6 relative to |in[k] * gain|.
+void mix_mono_to_stereo(float *out, float const *in, uint32_t count,
+	float start_l, float start_r, float step_l, float step_r);
+
+//Plain scalar version (reference for testing + benchmarking the vectorized version):
+void mix_mono_to_stereo_scalar(float *out, float const *in, uint32_t count,
+	float start_l, float start_r, float step_l, float step_r);
+
+//Name of the instruction set mix_mono_to_stereo was compiled for ("AVX", "SSE2", "NEON", or "scalar"):
+extern char const *mix_mono_to_stereo_isa;
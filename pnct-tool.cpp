@@ -0,0 +1,114 @@
+//Offline tool for processing '.pnct' mesh files (as written by scenes/export-meshes.py).
+// Build with:
+//  $ node Maekfile.js
+// Run with:
+//  $ scenes/pnct-tool [--optimize] <in.pnct> <out.pnct>
+// Welds identical vertices within each mesh and writes indexed meshes (16-bit indices when they fit).
+// With --optimize, also reorders triangles and vertices for the GPU's vertex cache (see MeshData::optimize()).
+//  $ scenes/pnct-tool --list <in.pnct>
+// Lists meshes and their bounds (without reading vertex data, if the file has a 'bnd0' chunk).
+
+#include "MeshData.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	try {
+#endif
+	bool optimize = false;
+	bool list = false;
+	std::string in_file, out_file;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--optimize") {
+			optimize = true;
+		} else if (arg == "--list") {
+			list = true;
+		} else if (in_file == "") {
+			in_file = arg;
+		} else if (out_file == "") {
+			out_file = arg;
+		} else {
+			in_file = ""; //(too many arguments)
+			break;
+		}
+	}
+	if (in_file == "" || (out_file == "") != list) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--optimize] <in.pnct> <out.pnct>\nWelds identical vertices and writes indexed meshes.\n --optimize also reorders triangles and vertices for vertex cache locality.\n"
+			<< "\t" << argv[0] << " --list <in.pnct>\nLists meshes and their bounds." << std::endl;
+		return 1;
+	}
+
+	if (list) {
+		ChunkFile file(in_file);
+		MeshData::View view = MeshData::view(file);
+		std::cout << "'" << in_file << "': " << view.vertices.size() << " vertices, "
+			<< (view.indexed ? std::to_string(view.index_count()) + " indices" : std::string("not indexed"))
+			<< (file.has_toc() ? ", has table of contents" : "") << "." << std::endl;
+		for (uint32_t i = 0; i < view.meshes.size(); ++i) {
+			MeshData::Mesh const &mesh = view.meshes[i];
+			std::cout << "  '" << mesh.name << "': vertices [" << mesh.vertex_begin << ", " << mesh.vertex_end << ")";
+			if (view.indexed) std::cout << ", indices [" << mesh.index_begin << ", " << mesh.index_end << ")";
+			if (!view.bounds.empty()) {
+				glm::vec3 const &min = view.bounds[i].min;
+				glm::vec3 const &max = view.bounds[i].max;
+				std::cout << ", bounds (" << min.x << ", " << min.y << ", " << min.z << ") - (" << max.x << ", " << max.y << ", " << max.z << ")";
+			}
+			std::cout << std::endl;
+		}
+		return 0;
+	}
+
+	MeshData data;
+	data.read(in_file);
+
+	//bytes used on the GPU by vertices and indices:
+	auto gpu_bytes = [](MeshData const &d) {
+		size_t index_size = (d.vertices.size() <= 0x10000 ? 2 : 4);
+		return d.vertices.size() * sizeof(MeshData::Vertex) + (d.indexed ? d.indices.size() * index_size : 0);
+	};
+
+	size_t before_vertices = data.vertices.size();
+	size_t before_bytes = gpu_bytes(data);
+	MeshData::CacheStats before_stats = data.cache_stats();
+
+	data.weld();
+	MeshData::CacheStats weld_stats = data.cache_stats();
+
+	if (optimize) data.optimize();
+
+	size_t after_vertices = data.vertices.size();
+	size_t after_bytes = gpu_bytes(data);
+
+	std::cout << "'" << in_file << "': " << data.meshes.size() << " meshes, "
+		<< data.indices.size() / 3 << " triangles." << std::endl;
+	std::cout << "  vertices: " << before_vertices << " -> " << after_vertices
+		<< " (" << (after_vertices ? float(before_vertices) / float(after_vertices) : 0.0f) << "x fewer)" << std::endl;
+	std::cout << "  vertex + index bytes: " << before_bytes << " -> " << after_bytes
+		<< " (" << (after_bytes ? float(before_bytes) / float(after_bytes) : 0.0f) << "x smaller)" << std::endl;
+	//post-transform vertex cache use (16-entry FIFO), as read -> welded -> optimized:
+	auto report_cache = [](char const *label, MeshData::CacheStats const &stats) {
+		std::cout << "  " << label << ": ACMR " << stats.acmr() << ", ATVR " << stats.atvr() << std::endl;
+	};
+	report_cache("vertex cache (as read)", before_stats);
+	report_cache("vertex cache (welded)", weld_stats);
+	if (optimize) report_cache("vertex cache (optimized)", data.cache_stats());
+
+	data.write(out_file);
+	std::cout << "Wrote '" << out_file << "'." << std::endl;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
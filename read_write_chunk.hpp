@@ -1,9 +1,13 @@
 #pragma once
 
 #include <iostream>
+#include <sstream>
 #include <vector>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -41,6 +45,21 @@ void read_chunk(std::istream &from, std::string const &magic, std::vector< T > *
 }
 
 
+//helper function that returns the magic number of the next chunk without reading it:
+// (returns an empty string at the end of the stream)
+inline std::string peek_chunk_magic(std::istream &from) {
+	char magic[4];
+	auto at = from.tellg();
+	if (!from.read(magic, 4)) {
+		from.clear();
+		from.seekg(at);
+		return "";
+	}
+	from.seekg(at);
+	return std::string(magic, 4);
+}
+
+
 //helper function to write a chunk of data in the same format as read_chunk:
 template< typename T >
 void write_chunk(std::string const &magic, std::vector< T > const &from, std::ostream *to_) {
@@ -63,3 +82,69 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+
+//Chunk files can (optionally) start with a table of contents chunk:
+// |t |o |c |0 |
+// |sz|sz|sz|sz|
+// |TOCEntry| * (sz/sizeof(TOCEntry)) <-- one entry for every chunk after the table of contents, in order
+//so readers (see ChunkFile) can find chunks without reading past the ones before them, and can check data integrity.
+struct TOCEntry {
+	char magic[4];
+	uint32_t size; //size of chunk data, in bytes
+	uint64_t offset; //offset of chunk data (just after its header) from the start of the file
+	uint32_t crc; //CRC-32 (as in zlib) of chunk data
+	uint32_t padding_;
+};
+static_assert(sizeof(TOCEntry) == 24, "TOCEntry is packed");
+
+//CRC-32 (polynomial 0xedb88320, as used by zlib and png), continuing from 'crc' if given:
+inline uint32_t crc32(void const *data, size_t size, uint32_t crc = 0) {
+	static uint32_t const *table = [](){
+		static uint32_t t[256];
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (uint32_t k = 0; k < 8; ++k) c = (c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1);
+			t[i] = c;
+		}
+		return t;
+	}();
+	uint8_t const *bytes = reinterpret_cast< uint8_t const * >(data);
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+//helper that collects chunks and then writes them after a table of contents:
+// ChunkWriter writer;
+// writer.add("pnct", vertices); writer.add("str0", strings); //...
+// writer.write(&file);
+struct ChunkWriter {
+	template< typename T >
+	void add(std::string const &magic, std::vector< T > const &from) {
+		assert(magic.size() == 4);
+		TOCEntry entry;
+		std::memcpy(entry.magic, magic.data(), 4);
+		entry.size = uint32_t(from.size() * sizeof(T));
+		entry.offset = uint64_t(data.tellp()) + 8; //(relative to the end of the table of contents, for now)
+		entry.crc = crc32(from.data(), entry.size);
+		entry.padding_ = 0;
+		toc.emplace_back(entry);
+		write_chunk(magic, from, &data);
+	}
+
+	void write(std::ostream *to) const {
+		assert(to);
+		std::vector< TOCEntry > final_toc = toc;
+		uint64_t toc_end = 8 + final_toc.size() * sizeof(TOCEntry);
+		for (auto &entry : final_toc) entry.offset += toc_end;
+		write_chunk("toc0", final_toc, to);
+		std::string const &bytes = data.str();
+		to->write(bytes.data(), bytes.size());
+	}
+
+	std::vector< TOCEntry > toc;
+	std::ostringstream data;
+};
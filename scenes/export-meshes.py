@@ -203,6 +203,8 @@ blob.write(struct.pack('4s',b'pnct')) #type
 blob.write(struct.pack('I', len(data))) #length
 blob.write(data)
 #second chunk: the strings
+#(padded so the chunks after them are 4-byte aligned, letting the game read them in place)
+strings += b'\0' * (-len(strings) % 4)
 blob.write(struct.pack('4s',b'str0')) #type
 blob.write(struct.pack('I', len(strings))) #length
 blob.write(strings)
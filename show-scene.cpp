@@ -120,6 +120,11 @@ int main(int argc, char **argv) {
 				drawable.pipeline.type = mesh.type;
 				drawable.pipeline.start = mesh.start;
 				drawable.pipeline.count = mesh.count;
+				drawable.pipeline.index_type = mesh.index_type;
+				drawable.pipeline.min = mesh.min;
+				drawable.pipeline.max = mesh.max;
+				drawable.pipeline.position_scale = mesh.position_scale;
+				drawable.pipeline.position_offset = mesh.position_offset;
 
 			});
 		} catch (std::exception &e) {
@@ -0,0 +1,244 @@
+#include "step_turtles.hpp"
+
+#include <cassert>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <emmintrin.h>
+	#define TURTLES_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	#include <arm_neon.h>
+	#define TURTLES_NEON
+#endif
+
+void TurtleArrays::resize(uint32_t count) {
+	x.resize(count, 0.0f);
+	y.resize(count, 0.0f);
+	angle.resize(count, 0.0f);
+	turn_dir.resize(count, 0.0f);
+	dead.resize(count, 0);
+	half_cos.resize(count, 1.0f);
+	half_sin.resize(count, 0.0f);
+}
+
+namespace {
+	constexpr float Pi = 3.14159265358979f;
+	constexpr float TwoPi = 6.28318530717959f;
+
+	//wrap an angle into [-pi, pi]:
+	float wrap_angle(float a) {
+		return a - TwoPi * std::round(a * (1.0f / TwoPi));
+	}
+}
+
+void step_turtles_scalar(TurtleArrays &turtles, float elapsed, float speed, float turn_speed, float pond_radius) {
+	float const move = speed * elapsed;
+	float const turn = turn_speed * elapsed;
+	for (uint32_t i = 0; i < turtles.size(); ++i) {
+		float &x = turtles.x[i];
+		float &y = turtles.y[i];
+		float &angle = turtles.angle[i];
+
+		x += move * std::cos(angle);
+		y += move * std::sin(angle);
+		angle += turtles.turn_dir[i] * turn;
+
+		float dist = std::sqrt(x * x + y * y);
+		if (dist > pond_radius) {
+			float around = std::atan2(y, x);
+			x = pond_radius * std::cos(around);
+			y = pond_radius * std::sin(around);
+			angle += Pi;
+		}
+		angle = wrap_angle(angle);
+
+		turtles.half_cos[i] = std::cos(0.5f * angle);
+		turtles.half_sin[i] = std::sin(0.5f * angle);
+	}
+}
+
+//The vectorized kernel is written once, in terms of a few operations on 'lanes' of floats,
+// which are provided for each instruction set:
+namespace {
+
+#if defined(TURTLES_SSE2)
+
+	struct Lanes {
+		static constexpr uint32_t Width = 4;
+		typedef __m128 F;
+		typedef __m128 Mask;
+		static F set(float v) { return _mm_set1_ps(v); }
+		static F load(float const *p) { return _mm_loadu_ps(p); }
+		static void store(float *p, F v) { _mm_storeu_ps(p, v); }
+		static F add(F a, F b) { return _mm_add_ps(a, b); }
+		static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+		static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+		static F div(F a, F b) { return _mm_div_ps(a, b); }
+		static F sqrt(F a) { return _mm_sqrt_ps(a); }
+		static F round(F a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); } //(round-to-nearest is the default rounding mode)
+		static Mask greater(F a, F b) { return _mm_cmpgt_ps(a, b); }
+		static Mask less(F a, F b) { return _mm_cmplt_ps(a, b); }
+		static Mask either(Mask a, Mask b) { return _mm_or_ps(a, b); }
+		static F select(Mask m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+	};
+	constexpr char const *Isa = "SSE2";
+
+#elif defined(TURTLES_NEON)
+
+	struct Lanes {
+		static constexpr uint32_t Width = 4;
+		typedef float32x4_t F;
+		typedef uint32x4_t Mask;
+		static F set(float v) { return vdupq_n_f32(v); }
+		static F load(float const *p) { return vld1q_f32(p); }
+		static void store(float *p, F v) { vst1q_f32(p, v); }
+		static F add(F a, F b) { return vaddq_f32(a, b); }
+		static F sub(F a, F b) { return vsubq_f32(a, b); }
+		static F mul(F a, F b) { return vmulq_f32(a, b); }
+		static F div(F a, F b) { return vdivq_f32(a, b); }
+		static F sqrt(F a) { return vsqrtq_f32(a); }
+		static F round(F a) { return vrndnq_f32(a); }
+		static Mask greater(F a, F b) { return vcgtq_f32(a, b); }
+		static Mask less(F a, F b) { return vcltq_f32(a, b); }
+		static Mask either(Mask a, Mask b) { return vorrq_u32(a, b); }
+		static F select(Mask m, F a, F b) { return vbslq_f32(m, a, b); }
+	};
+	constexpr char const *Isa = "NEON";
+
+#else
+
+	struct Lanes {
+		static constexpr uint32_t Width = 1;
+		typedef float F;
+		typedef bool Mask;
+		static F set(float v) { return v; }
+		static F load(float const *p) { return *p; }
+		static void store(float *p, F v) { *p = v; }
+		static F add(F a, F b) { return a + b; }
+		static F sub(F a, F b) { return a - b; }
+		static F mul(F a, F b) { return a * b; }
+		static F div(F a, F b) { return a / b; }
+		static F sqrt(F a) { return std::sqrt(a); }
+		static F round(F a) { return std::nearbyint(a); }
+		static Mask greater(F a, F b) { return a > b; }
+		static Mask less(F a, F b) { return a < b; }
+		static Mask either(Mask a, Mask b) { return a || b; }
+		static F select(Mask m, F a, F b) { return m ? a : b; }
+	};
+	constexpr char const *Isa = "scalar";
+
+#endif
+
+	typedef Lanes L;
+
+	//wrap angles into [-pi, pi]:
+	L::F wrap_angles(L::F a) {
+		return L::sub(a, L::mul(L::set(TwoPi), L::round(L::mul(a, L::set(1.0f / TwoPi)))));
+	}
+
+	//sine and cosine of angles (any angle; accurate to about 1e-6 in [-pi, pi]):
+	void sin_cos(L::F a, L::F *s, L::F *c) {
+		//reduce to [-pi, pi]:
+		L::F r = wrap_angles(a);
+		//...and then to [-pi/2, pi/2], using sin(pi - r) == sin(r), cos(pi - r) == -cos(r):
+		L::Mask high = L::greater(r, L::set(0.5f * Pi));
+		L::Mask low = L::less(r, L::set(-0.5f * Pi));
+		r = L::select(high, L::sub(L::set(Pi), r), L::select(low, L::sub(L::set(-Pi), r), r));
+		L::F cos_sign = L::select(L::either(high, low), L::set(-1.0f), L::set(1.0f));
+
+		//Taylor series (through r^11 for sine and r^12 for cosine):
+		L::F r2 = L::mul(r, r);
+		L::F sp = L::set(-1.0f / 39916800.0f);
+		sp = L::add(L::mul(sp, r2), L::set(1.0f / 362880.0f));
+		sp = L::add(L::mul(sp, r2), L::set(-1.0f / 5040.0f));
+		sp = L::add(L::mul(sp, r2), L::set(1.0f / 120.0f));
+		sp = L::add(L::mul(sp, r2), L::set(-1.0f / 6.0f));
+		sp = L::add(L::mul(sp, r2), L::set(1.0f));
+		*s = L::mul(sp, r);
+
+		L::F cp = L::set(1.0f / 479001600.0f);
+		cp = L::add(L::mul(cp, r2), L::set(-1.0f / 3628800.0f));
+		cp = L::add(L::mul(cp, r2), L::set(1.0f / 40320.0f));
+		cp = L::add(L::mul(cp, r2), L::set(-1.0f / 720.0f));
+		cp = L::add(L::mul(cp, r2), L::set(1.0f / 24.0f));
+		cp = L::add(L::mul(cp, r2), L::set(-1.0f / 2.0f));
+		cp = L::add(L::mul(cp, r2), L::set(1.0f));
+		*c = L::mul(cp, cos_sign);
+	}
+
+	//pointers to the arrays of a TurtleArrays:
+	struct TurtlePointers {
+		float *x, *y, *angle, *turn_dir, *half_cos, *half_sin;
+	};
+
+	//step turtles [begin, begin + L::Width):
+	// (the same steps as step_turtles_scalar, but moving turtles back into the pond by scaling instead of atan2 + sin/cos)
+	inline void step_lanes(TurtlePointers const &turtles, uint32_t begin, L::F move, L::F turn, L::F pond_radius) {
+		L::F x = L::load(&turtles.x[begin]);
+		L::F y = L::load(&turtles.y[begin]);
+		L::F angle = L::load(&turtles.angle[begin]);
+
+		L::F s, c;
+		sin_cos(angle, &s, &c);
+		x = L::add(x, L::mul(move, c));
+		y = L::add(y, L::mul(move, s));
+		angle = L::add(angle, L::mul(L::load(&turtles.turn_dir[begin]), turn));
+
+		L::F dist = L::sqrt(L::add(L::mul(x, x), L::mul(y, y)));
+		L::Mask outside = L::greater(dist, pond_radius);
+		L::F scale = L::select(outside, L::div(pond_radius, dist), L::set(1.0f));
+		x = L::mul(x, scale);
+		y = L::mul(y, scale);
+		angle = wrap_angles(L::add(angle, L::select(outside, L::set(Pi), L::set(0.0f))));
+
+		L::store(&turtles.x[begin], x);
+		L::store(&turtles.y[begin], y);
+		L::store(&turtles.angle[begin], angle);
+
+		sin_cos(L::mul(angle, L::set(0.5f)), &s, &c);
+		L::store(&turtles.half_cos[begin], c);
+		L::store(&turtles.half_sin[begin], s);
+	}
+}
+
+char const *step_turtles_isa = Isa;
+
+void step_turtles(TurtleArrays &turtles, float elapsed, float speed, float turn_speed, float pond_radius) {
+	assert(turtles.y.size() == turtles.size() && turtles.angle.size() == turtles.size() && turtles.turn_dir.size() == turtles.size());
+	assert(turtles.half_cos.size() == turtles.size() && turtles.half_sin.size() == turtles.size());
+
+	L::F const move = L::set(speed * elapsed);
+	L::F const turn = L::set(turn_speed * elapsed);
+	L::F const radius = L::set(pond_radius);
+
+	TurtlePointers pointers{
+		turtles.x.data(), turtles.y.data(), turtles.angle.data(), turtles.turn_dir.data(),
+		turtles.half_cos.data(), turtles.half_sin.data()
+	};
+
+	uint32_t i = 0;
+	for (; i + L::Width <= turtles.size(); i += L::Width) {
+		step_lanes(pointers, i, move, turn, radius);
+	}
+	//leftover turtles:
+	if (i < turtles.size()) {
+		//(copied into a full set of lanes, so they get exactly the same treatment as the others)
+		float rest[6][L::Width] = { };
+		TurtlePointers rest_pointers{ rest[0], rest[1], rest[2], rest[3], rest[4], rest[5] };
+		uint32_t count = turtles.size() - i;
+		for (uint32_t j = 0; j < count; ++j) {
+			rest_pointers.x[j] = turtles.x[i+j];
+			rest_pointers.y[j] = turtles.y[i+j];
+			rest_pointers.angle[j] = turtles.angle[i+j];
+			rest_pointers.turn_dir[j] = turtles.turn_dir[i+j];
+		}
+		step_lanes(rest_pointers, 0, move, turn, radius);
+		for (uint32_t j = 0; j < count; ++j) {
+			turtles.x[i+j] = rest_pointers.x[j];
+			turtles.y[i+j] = rest_pointers.y[j];
+			turtles.angle[i+j] = rest_pointers.angle[j];
+			turtles.half_cos[i+j] = rest_pointers.half_cos[j];
+			turtles.half_sin[i+j] = rest_pointers.half_sin[j];
+		}
+	}
+}
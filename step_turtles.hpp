@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+//Turtle simulation kernel used by PlayMode.
+//
+//Turtle state is kept as parallel arrays (one entry per turtle), so that the
+// per-frame update can run over many turtles at once:
+struct TurtleArrays {
+	std::vector< float > x, y; //position (relative to the pond's center)
+	std::vector< float > angle; //heading (radians counterclockwise from +x), in [-pi, pi]
+	std::vector< float > turn_dir; //-1 for clockwise, 0 for straight, 1 for counterclockwise
+	std::vector< uint8_t > dead; //nonzero once eaten (not used by step_turtles)
+
+	//computed by step_turtles (for building each turtle's rotation about z):
+	std::vector< float > half_cos, half_sin; //cos(angle / 2), sin(angle / 2)
+
+	void resize(uint32_t count);
+	uint32_t size() const { return uint32_t(x.size()); }
+};
+
+//Advances every turtle by 'elapsed' seconds:
+// - moves it 'speed * elapsed' along its heading,
+// - turns it by 'turn_dir * turn_speed * elapsed',
+// - puts it back on the edge of the pond (and turns it around) if it is farther than 'pond_radius' from the center,
+// - and updates half_cos / half_sin from the new heading.
+//Uses SSE2 or NEON when the compiler targets them, and scalar code otherwise.
+//Sines and cosines are computed with polynomials (max error about 1e-6), so results
+// differ slightly from step_turtles_scalar.
+void step_turtles(TurtleArrays &turtles, float elapsed, float speed, float turn_speed, float pond_radius);
+
+//Plain scalar version using the standard library's trig functions (reference for testing + benchmarking):
+void step_turtles_scalar(TurtleArrays &turtles, float elapsed, float speed, float turn_speed, float pond_radius);
+
+//Name of the instruction set step_turtles was compiled for ("SSE2", "NEON", or "scalar"):
+extern char const *step_turtles_isa;